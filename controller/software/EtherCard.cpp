@@ -147,8 +147,8 @@ void Stash::prepare (PGM_P fmt, ...) {
 #ifdef __AVR__
     *segs++ = (uint16_t) fmt;
 #else
-    *segs++ = (uint32_t) fmt;
-    *segs++ = (uint32_t) fmt >> 16;
+    *segs++ = (uintptr_t) fmt;
+    *segs++ = (uintptr_t) fmt >> 16;
 #endif
     va_list ap;
     va_start(ap, fmt);
@@ -414,3 +414,11 @@ bool EtherCard::staticSetup (const uint8_t* my_ip,
     delaycnt = 0; //request gateway ARP lookup
     return true;
 }
+
+void EtherCard::copyIp (uint8_t *dst, const uint8_t *src) {
+    memcpy(dst, src, 4);
+}
+
+void EtherCard::copyMac (uint8_t *dst, const uint8_t *src) {
+    memcpy(dst, src, 6);
+}
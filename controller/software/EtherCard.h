@@ -234,6 +234,8 @@ public:
     static uint8_t dnsip[4];  ///< DNS server IP address
     static uint8_t hisip[4];  ///< DNS lookup result
     static uint16_t hisport;  ///< TCP port to connect to (default 80)
+    static bool using_dhcp;   ///< True if using DHCP
+    static bool persist_tcp_connection; ///< False to break connections on first packet received
     static int16_t delaycnt; ///< Counts number of cycles of packetLoop when no packet received - used to trigger periodic gateway ARP request
 
     // EtherCard.cpp
@@ -0,0 +1,133 @@
+// transmit side of the serial link to the segments
+//
+// TxRing holds the bytes for the usart: the udp handler puts them in, the data register
+// empty interrupt takes them out, so a datagram is handed over while the previous one is
+// still being transmitted. TxExpander turns the bytes of a datagram into segment bytes.
+// both are plain c++ without avr or arduino headers, so they also build on the host.
+
+#ifndef TX_RING_H
+#define TX_RING_H
+
+#include <stdint.h>
+
+// power of 2, at most 256 so head and tail are single bytes that both sides read at once
+#define TX_RING_SIZE 256
+#define TX_RING_MASK (TX_RING_SIZE - 1)
+
+// pixels in a frame, 7 pixels per byte stops here
+#define TX_FRAME_PIXELS (96 * 48)
+
+// one side puts, the other side gets, holds TX_RING_SIZE - 1 bytes
+class TxRing
+{
+public:
+	TxRing() : head(0), tail(0) {}
+
+	bool empty() { return head == tail; }
+	uint16_t used() { return (uint8_t)(head - tail) & TX_RING_MASK; }
+
+	// false when the ring is full
+	bool put(uint8_t value)
+	{
+		uint8_t next = (head + 1) & TX_RING_MASK;
+		if(next == tail)
+			return false;
+		data[head] = value;
+		head = next;
+		return true;
+	}
+
+	// false when the ring is empty
+	bool get(uint8_t* value)
+	{
+		uint8_t pos = tail;
+		if(pos == head)
+			return false;
+		*value = data[pos];
+		tail = (pos + 1) & TX_RING_MASK;
+		return true;
+	}
+
+private:
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	uint8_t data[TX_RING_SIZE];
+};
+
+// bytes from the network:
+//	0x80: start of a frame, sent on, back to 1 pixel per byte
+//	0x81 - 0x8f: pixels per byte, 1 or 7, not sent on
+//	0x90 and up: segment commands, sent on with their parameter bytes
+//	0x00 - 0x7f: a pixel, or with 7 pixels per byte bit n is pixel n (0x7f when set)
+class TxExpander
+{
+public:
+	TxExpander() : pixels_per_byte(1), params(0), pixels(0) {}
+
+	uint8_t pixelsPerByte() { return pixels_per_byte; }
+
+	// the segment bytes for one byte from the network, returns how many were written to
+	// out, at most 7
+	uint8_t expand(uint8_t value, uint8_t* out)
+	{
+		if(params)
+		{
+			params--;
+			out[0] = value;
+			return 1;
+		}
+		if(value & 0x80)
+		{
+			if(value == 0x80)
+			{
+				pixels_per_byte = 1;
+				pixels = 0;
+				out[0] = value;
+				return 1;
+			}
+			if(value >= 0x90)
+			{
+				params = commandParams(value);
+				out[0] = value;
+				return 1;
+			}
+			pixels_per_byte = value & 0x0f;
+			return 0;
+		}
+		if(pixels_per_byte != 7)
+		{
+			pixels++;
+			out[0] = value;
+			return 1;
+		}
+		uint8_t count = 0;
+		for(int i = 0; i < 7 && pixels < TX_FRAME_PIXELS; i++)
+		{
+			out[count++] = (value & 0x01) ? 0x7f : 0x00;
+			value >>= 1;
+			pixels++;
+		}
+		return count;
+	}
+
+private:
+	uint8_t pixels_per_byte;
+	// parameter bytes of a segment command still to come
+	uint8_t params;
+	// pixels since the start of the frame
+	uint16_t pixels;
+
+	// parameter bytes of the segment commands in segment/software/uart.h,
+	// phase sync (0xb0 - 0xbf) has none
+	static uint8_t commandParams(uint8_t command)
+	{
+		switch(command)
+		{
+			case 0xa0: return 1;	// brightness: level
+			case 0xa1: return 2;	// fade: level, steps
+			default: return 0;
+		}
+	}
+};
+
+#endif // TX_RING_H
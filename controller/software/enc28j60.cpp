@@ -466,7 +466,7 @@ uint16_t ENC28J60::packetReceive() {
         /// of the packet) and wishes to free the buffer space used
         /// by the processed data, the host controller must
         /// advance the receive buffer read pointer, ERXRDPT."
-        if (gNextPacketPtr - 1 > RXSTOP_INIT)
+        if (gNextPacketPtr == RXSTART_INIT) // just before the start is the end of the ring
             writeReg(ERXRDPT, RXSTOP_INIT);
         else
             writeReg(ERXRDPT, gNextPacketPtr - 1);
@@ -693,7 +693,7 @@ uint16_t ENC28J60::specialPacketReceive(bool (*isMySpecialPacket)(byte*, uint16_
         /// of the packet) and wishes to free the buffer space used
         /// by the processed data, the host controller must
         /// advance the receive buffer read pointer, ERXRDPT."
-        if (gNextPacketPtr - 1 > RXSTOP_INIT)
+        if (gNextPacketPtr == RXSTART_INIT) // just before the start is the end of the ring
             writeReg(ERXRDPT, RXSTOP_INIT);
         else
             writeReg(ERXRDPT, gNextPacketPtr - 1);
@@ -1,7 +1,9 @@
 #include "EtherCard.h"
 #include "IPAddress.h"
 #include "EEPROMAnything.h"
+#include "TxRing.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
 
 #define DEBUG 0
 
@@ -39,10 +41,37 @@ byte calculate_config_checksum(byte* data)
 	return checksum;
 }
 
-#define SERIAL_WAIT() while(!(UCSR0A & (1<<UDRE0)))
-#define SERIAL_WRITE(x) SERIAL_WAIT(); UDR0 = x
+#if !DEBUG
+// serial output to the segments, queued in tx_ring and written by the usart data register
+// empty interrupt, the arduino Serial is not used because it has its own interrupt
+static TxRing tx_ring;
+static TxExpander tx_expander;
 
-byte pixels_per_byte = 1;
+ISR(USART_UDRE_vect)
+{
+	byte val;
+	if(tx_ring.get(&val))
+		UDR0 = val;
+	else
+		UCSR0B &= ~(1 << UDRIE0); // nothing left, until serialWrite starts it again
+}
+
+// 500000 baud at 16MHz, 8N1
+void serialSetup()
+{
+	UCSR0A = 1 << U2X0;
+	UBRR0 = 3;
+	UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+	UCSR0B = 1 << TXEN0;
+}
+
+// queue a byte, only waits when the ring is full
+void serialWrite(byte val)
+{
+	while(!tx_ring.put(val));
+	UCSR0B |= 1 << UDRIE0;
+}
+#endif
 
 void udpReceive(word port, byte ip[4], const char *chr_data, word len)
 {
@@ -55,47 +84,24 @@ void udpReceive(word port, byte ip[4], const char *chr_data, word len)
 			#if DEBUG
 			Serial.println("I FAILED YOU MY MASTER");
 			#else
+			byte pixels_per_byte = tx_expander.pixelsPerByte();
 			if(pixels_per_byte != 1 && pixels_per_byte != 7)
 			{
-				SERIAL_WRITE(0x80);
+				serialWrite(0x80);
 				for(int i = 0; i < pixels_per_byte; i++)
 				{
-					SERIAL_WRITE(0x7f);
+					serialWrite(0x7f);
 				}
 				break;
 			}
+			// the handler returns as soon as the datagram is queued, the next one is read
+			// from the ENC28J60 while this one is transmitted
+			byte out[7];
 			for(int i = 0; i < len; i++)
 			{
-				byte val = *data++;
-
-				if((val & 0x80) == 0)
-				{
-					val &= 0x7f;
-					switch(pixels_per_byte)
-					{
-						case 0:
-						case 1:
-							SERIAL_WRITE(val);
-							break;
-						case 7:
-							for(int i = 1; i < 7; i++)
-							{
-								SERIAL_WRITE((val & 0x01) ? 0x7f : 0x00);
-								val >>= 1;
-							}
-							break;
-					}
-				}
-				else
-				{
-					if(val != 0x80)
-					{
-						pixels_per_byte = val & 0x0f;
-						continue;
-					}
-					pixels_per_byte = 1;
-					SERIAL_WRITE(val & 0x80);
-				}
+				byte count = tx_expander.expand(*data++, out);
+				for(byte j = 0; j < count; j++)
+					serialWrite(out[j]);
 			}
 			#endif
 			// Serial.write((const uint8_t*)data, len);
@@ -159,7 +165,7 @@ void setup()
 	Serial.begin(115200);
 	Serial.println("DEBUG");
 	#else
-	Serial.begin(500000);
+	serialSetup();
 	#endif
 
 	eeprom_read_config();
@@ -183,10 +189,10 @@ void setup()
 	#else
 	delay(3000);
 	for(int i = 0; i < 5; i++)
-		Serial.write(0x80);
+		serialWrite(0x80);
 	for(int i = 0; i < 96*48; i++)
 	{
-		Serial.write(0);
+		serialWrite(0);
 	}
 	#endif
 
@@ -52,7 +52,7 @@ def send(data):
 	# print(data)
 	# sys.exit(1)
 	# print(len(data))
-	data = b'\x80' + compress(data)
+	data = b'\x80' + compress(data) + b'\x90'
 	total_len = len(data)
 	print(total_len)
 	while(len(data) > 0):
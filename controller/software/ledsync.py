@@ -0,0 +1,111 @@
+# drives a sign made of several ledboards in sync:
+# every board gets its part of the frame with 0x52 (prepare), then one 0x53 (present)
+# sync pulse goes to the multicast group all controllers listen on
+#
+# usage:
+#	python3 ledsync.py host[:port] ...		boards started with -m 239.255.13.37
+#	python3 ledsync.py --local 3			start 3 controllers on this host, each
+#											writing to a pty, and report their skew
+
+import os
+import pty
+import select
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+SYNC_GROUP = ('239.255.13.37', 1339)
+WIDTH = 96
+HEIGHT = 48
+FPS = 10
+FRAMES = 50
+
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+s.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+s.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+
+def now_us():
+	return time.monotonic_ns() // 1000
+
+def prepare(board, n, frame, boards):
+	# a bar moving over the whole sign, each board draws its own part
+	x = (frame * 4) % (WIDTH * boards) - n * WIDTH
+	data = b'\x04\x01' + bytes([0x30, 0, 0, WIDTH, HEIGHT, 0])
+	if -8 < x < WIDTH:
+		data += bytes([0x30, max(x, 0), 0, 8 + min(x, 0), HEIGHT, 0xff])
+	data += b'\x52' + struct.pack('>I', frame)
+	s.sendto(data, board)
+
+def present(frame):
+	s.sendto(b'\x53' + struct.pack('>IQ', frame, now_us()), SYNC_GROUP)
+
+def read_stats(port):
+	st = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	st.settimeout(1)
+	st.sendto(b'', ('127.0.0.1', port))
+	values = {}
+	for line in st.recv(65507).decode().splitlines():
+		if line.startswith('ledboard_sync_'):
+			name, value = line.rsplit(' ', 1)
+			values[name] = float(value)
+	st.close()
+	return values
+
+def run(boards, ptys=()):
+	for frame in range(FRAMES):
+		for n, board in enumerate(boards):
+			prepare(board, n, frame, len(boards))
+		# give the controllers time to draw before the pulse
+		time.sleep(0.002)
+		present(frame)
+		end = time.monotonic() + 1.0 / FPS
+		# the segments are not there to read the serial data, so drain the ptys
+		while time.monotonic() < end:
+			ready, _, _ = select.select(ptys, [], [], max(0, end - time.monotonic()))
+			for fd in ready:
+				os.read(fd, 65536)
+
+def local(count):
+	binary = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'sprite_ledboard_rpi', 'ledboard')
+	procs = []
+	masters = []
+	boards = []
+	for i in range(count):
+		master, slave = pty.openpty()
+		masters.append(master)
+		port = 14000 + i
+		boards.append(('127.0.0.1', port))
+		procs.append(subprocess.Popen([binary, '-d', os.ttyname(slave), '-p', str(port),
+			'-s', str(15000 + i), '-m', '%s:%d' % SYNC_GROUP], stdout=subprocess.DEVNULL))
+		os.close(slave)
+	time.sleep(0.5)
+	try:
+		run(boards, masters)
+		time.sleep(0.2)
+		stats = [read_stats(15000 + i) for i in range(count)]
+	finally:
+		for proc in procs:
+			proc.terminate()
+			proc.wait()
+
+	# all controllers share the monotonic clock, so the start times of the last frame compare directly
+	started = [st['ledboard_sync_started_seconds'] for st in stats]
+	for i, st in enumerate(stats):
+		print('board %d: %d frames, %d missed, mean sync latency %.1f us, last frame %d started at %+.1f us' % (
+			i, st['ledboard_sync_frames_total'], st['ledboard_sync_frames_missed_total'],
+			st['ledboard_sync_latency_seconds_sum'] / max(st['ledboard_sync_latency_seconds_count'], 1) * 1e6,
+			st['ledboard_sync_frame'], (started[i] - min(started)) * 1e6))
+	print('skew: %.1f us' % ((max(started) - min(started)) * 1e6))
+
+if len(sys.argv) > 2 and sys.argv[1] == '--local':
+	local(int(sys.argv[2]))
+elif len(sys.argv) > 1:
+	boards = []
+	for arg in sys.argv[1:]:
+		host, _, port = arg.partition(':')
+		boards.append((host, int(port or 1337)))
+	run(boards)
+else:
+	print('usage: %s host[:port] ... | --local count' % sys.argv[0])
@@ -0,0 +1,174 @@
+#include "Capture.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static void writeLe(uint8_t* out, uint64_t value, int size)
+{
+	for(int i = 0; i < size; i++)
+		out[i] = value >> (8 * i);
+}
+
+static uint64_t readLe(const uint8_t* in, int size)
+{
+	uint64_t value = 0;
+	for(int i = 0; i < size; i++)
+		value |= (uint64_t)in[i] << (8 * i);
+	return value;
+}
+
+bool CaptureWriter::open(const char* path)
+{
+	records = bytes = 0;
+	used = 0;
+	last = 0;
+	fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if(fd < 0)
+	{
+		printf("Error opening capture file %s!\n", path);
+		return false;
+	}
+	// the start time is filled in by the first record
+	memcpy(buffer, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+	memset(buffer + CAPTURE_MAGIC_SIZE, 0, CAPTURE_HEADER_SIZE - CAPTURE_MAGIC_SIZE);
+	used = CAPTURE_HEADER_SIZE;
+	return true;
+}
+
+void CaptureWriter::record(uint64_t now, const struct sockaddr_in* src, uint16_t port, const uint8_t* data, uint16_t len)
+{
+	if(fd < 0)
+		return;
+	if(used + CAPTURE_RECORD_SIZE + len > CAPTURE_BUFFER_SIZE)
+	{
+		flush();
+		if(fd < 0)
+			return;
+	}
+
+	if(!last)
+	{
+		// still in the buffer, flush writes nothing before the first record
+		writeLe(buffer + CAPTURE_MAGIC_SIZE, now, 8);
+		last = now;
+	}
+	// gaps of more than an hour are shortened
+	uint64_t delta = (now - last) / 1000;
+	if(delta > 0xffffffff) delta = 0xffffffff;
+	last += delta * 1000;
+
+	uint8_t* out = buffer + used;
+	writeLe(out, delta, 4);
+	if(src)
+	{
+		memcpy(out + 4, &src->sin_addr.s_addr, 4);
+		memcpy(out + 8, &src->sin_port, 2);
+	}
+	else
+	{
+		memset(out + 4, 0, 6);
+	}
+	writeLe(out + 10, port, 2);
+	writeLe(out + 12, len, 2);
+	memcpy(out + CAPTURE_RECORD_SIZE, data, len);
+	used += CAPTURE_RECORD_SIZE + len;
+	records++;
+	bytes += len;
+}
+
+void CaptureWriter::flush()
+{
+	if(last)
+		write();
+}
+
+void CaptureWriter::write()
+{
+	size_t pos = 0;
+	while(fd >= 0 && pos < used)
+	{
+		ssize_t written = ::write(fd, buffer + pos, used - pos);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			// a full disk ends the capture, the file stays valid up to the last whole record
+			printf("Error writing capture file, capture stopped!\n");
+			::close(fd);
+			fd = -1;
+			break;
+		}
+		pos += written;
+	}
+	used = 0;
+}
+
+void CaptureWriter::close()
+{
+	// a capture without records is only the header
+	write();
+	if(fd >= 0)
+		::close(fd);
+	fd = -1;
+}
+
+bool CaptureReader::open(const char* path)
+{
+	int fd = ::open(path, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) < 0)
+	{
+		printf("Error opening capture file %s!\n", path);
+		if(fd >= 0)
+			::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	void* map = size ? mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if(map == MAP_FAILED || size < CAPTURE_HEADER_SIZE || memcmp(map, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE))
+	{
+		printf("%s is not a capture file!\n", path);
+		if(map != MAP_FAILED)
+			munmap(map, size);
+		return false;
+	}
+	file = (const uint8_t*)map;
+	pos = CAPTURE_HEADER_SIZE;
+	time = 0;
+	return true;
+}
+
+bool CaptureReader::next(CaptureRecord* record)
+{
+	if(!file || size - pos < CAPTURE_RECORD_SIZE)
+		return false;
+	const uint8_t* in = file + pos;
+	uint16_t len = readLe(in + 12, 2);
+	if(size - pos - CAPTURE_RECORD_SIZE < len)
+		return false;
+
+	time += readLe(in, 4) * 1000;
+	record->time = time;
+	memset(&record->src, 0, sizeof record->src);
+	record->src.sin_family = AF_INET;
+	memcpy(&record->src.sin_addr.s_addr, in + 4, 4);
+	memcpy(&record->src.sin_port, in + 8, 2);
+	record->stream = !record->src.sin_addr.s_addr && !record->src.sin_port;
+	record->port = readLe(in + 10, 2);
+	record->data = in + CAPTURE_RECORD_SIZE;
+	record->len = len;
+	pos += CAPTURE_RECORD_SIZE + len;
+	return true;
+}
+
+void CaptureReader::close()
+{
+	if(file)
+		munmap((void*)file, size);
+	file = 0;
+}
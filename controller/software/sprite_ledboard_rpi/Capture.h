@@ -0,0 +1,82 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+// capture file of received LMCP, sACN and Art-Net traffic, written append only
+// all numbers are little endian, address and port are kept in network byte order:
+//	header: "LMCPCAP" 0x01, u64 monotonic time of the first record in ns
+//	record: u32 us since the previous record, u32 address, u16 port, u16 local port,
+//		u16 length, data
+// the local port is the one the datagram was received on, it tells the inputs apart
+// stream blocks have address, port and local port 0
+#define CAPTURE_MAGIC "LMCPCAP\x01"
+#define CAPTURE_MAGIC_SIZE 8
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_RECORD_SIZE 14
+// records are collected and written in blocks of this size
+#define CAPTURE_BUFFER_SIZE (256 * 1024)
+
+class CaptureWriter
+{
+public:
+	CaptureWriter() : fd(-1), used(0), last(0) {};
+
+	// create or truncate path
+	bool open(const char* path);
+	bool isOpen() { return fd >= 0; }
+	// src 0 and port 0 for stream blocks, port is the local port
+	void record(uint64_t now, const struct sockaddr_in* src, uint16_t port, const uint8_t* data, uint16_t len);
+	// write the collected records, called regularly so a killed controller loses little
+	// nothing is written before the first record, it sets the start time in the header
+	void flush();
+	void close();
+
+	// counters
+	uint64_t records;
+	uint64_t bytes;
+
+private:
+	int fd;
+	uint8_t buffer[CAPTURE_BUFFER_SIZE];
+	size_t used;
+	// time of the previous record, 0 before the first
+	uint64_t last;
+
+	void write();
+};
+
+struct CaptureRecord
+{
+	// ns since the first record
+	uint64_t time;
+	// whether the record came from a stream connection instead of a datagram
+	bool stream;
+	struct sockaddr_in src;
+	// local port the datagram was received on, 0 for streams
+	uint16_t port;
+	const uint8_t* data;
+	uint16_t len;
+};
+
+// reads a capture file mapped into memory
+class CaptureReader
+{
+public:
+	CaptureReader() : file(0), size(0), pos(0), time(0) {};
+
+	bool open(const char* path);
+	// the next record, false at the end of the file or at a record that was cut off
+	bool next(CaptureRecord* record);
+	void close();
+
+private:
+	const uint8_t* file;
+	size_t size;
+	size_t pos;
+	uint64_t time;
+};
+
+#endif //_CAPTURE_H_
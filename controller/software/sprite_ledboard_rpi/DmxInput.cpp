@@ -0,0 +1,262 @@
+#include "DmxInput.h"
+#include "Stats.h"
+#include "defines.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+
+sACN (E1.31) data packets, offsets in bytes, multi byte values are big endian
+	4:		ACN packet identifier "ASC-E1.17\0\0\0"
+	18:		uint32_t root vector, 4: data, 8: extended (sync)
+	40:		uint32_t framing vector, 2: data
+	109:	uint16_t synchronization address, 0: the sender does not sync
+	112:	uint8_t options, 0x40: preview data, 0x20: stream terminated
+	113:	uint16_t universe
+	125:	uint8_t start code, 0 for dimmer data
+	123:	uint16_t property count, start code included
+	126:	uint8_t channels[property count - 1]
+sACN sync packets
+	18:		uint32_t root vector 8
+	40:		uint32_t framing vector 1
+	45:		uint16_t synchronization address
+each universe is sent to the multicast group 239.255.<universe high>.<universe low>
+
+Art-Net, little endian opcode, other values big endian
+	0:		"Art-Net\0"
+	8:		uint16_t opcode, 0x5000: ArtDmx, 0x5200: ArtSync
+	ArtDmx:
+	14:		uint8_t SubUni, low byte of the universe
+	15:		uint8_t Net, high 7 bits of the universe
+	16:		uint16_t length
+	18:		uint8_t channels[length]
+
+*/
+
+// size of the headers in front of the channel data
+#define E131_DATA_OFFSET 126
+#define E131_SYNC_SIZE 49
+#define ARTNET_DATA_OFFSET 18
+// without ArtSync packets for this long, frames are written when their universes are complete again
+#define DMX_SYNC_TIMEOUT_NS (2 * NS_PER_SEC)
+
+DmxInput* DmxInput::instance;
+
+bool DmxInput::addMapping(const char* rule)
+{
+	if(mapping_count >= DMX_MAPPINGS_MAX)
+		return false;
+
+	const char* equals = strchr(rule, '=');
+	if(!equals)
+		return false;
+	int universe = atoi(rule);
+	int pixel = atoi(equals + 1);
+	const char* colon = strchr(equals, ':');
+	int count = colon ? atoi(colon + 1) : DMX_CHANNELS;
+	if(universe < 0 || universe > 63999 || pixel < 0 || count < 1 || count > DMX_CHANNELS)
+		return false;
+
+	mappings[mapping_count].universe = universe;
+	mappings[mapping_count].pixel = pixel;
+	mappings[mapping_count].count = count;
+	mapping_count++;
+	return true;
+}
+
+void DmxInput::attach(LedBoard* board, SourceTable* sources, FrameCallback callback)
+{
+	this->board = board;
+	this->sources = sources;
+	this->callback = callback;
+	instance = this;
+
+	// universes 1 and up fill the board row by row, 9 universes of 512 pixels
+	if(mapping_count == 0)
+	{
+		for(int i = 0; i < 9; i++)
+		{
+			mappings[i].universe = 1 + i;
+			mappings[i].pixel = i * DMX_CHANNELS;
+			mappings[i].count = DMX_CHANNELS;
+		}
+		mapping_count = 9;
+	}
+}
+
+bool DmxInput::open(EventLoop* loop, LedBoard* board, SourceTable* sources, FrameCallback callback, CaptureWriter* capture)
+{
+	this->loop = loop;
+	this->capture = capture;
+	attach(board, sources, callback);
+
+	if(!e131.open(E131_PORT, RECV_BATCH_DEFAULT, 0) || !artnet.open(ARTNET_PORT, RECV_BATCH_DEFAULT, 0))
+		return false;
+	for(int i = 0; i < mapping_count; i++)
+	{
+		char group[16];
+		snprintf(group, sizeof group, "239.255.%d.%d", mappings[i].universe >> 8, mappings[i].universe & 0xff);
+		// joining fails without a multicast route, unicast sACN still works
+		e131.join(group);
+	}
+
+	return loop->addFd(e131.fd(), EPOLLIN, &e131Event, this) &&
+		loop->addFd(artnet.fd(), EPOLLIN, &artnetEvent, this);
+}
+
+void DmxInput::e131Event(int fd, uint32_t events, void* ctx)
+{
+	((DmxInput*)ctx)->e131.receive(&e131Receive, false);
+}
+
+void DmxInput::artnetEvent(int fd, uint32_t events, void* ctx)
+{
+	((DmxInput*)ctx)->artnet.receive(&artnetReceive, false);
+}
+
+static uint32_t readUint32(const uint8_t* data)
+{
+	return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+void DmxInput::e131Receive(const uint8_t* data, uint16_t len, const struct sockaddr_in* src)
+{
+	uint64_t now = statsNow();
+	if(instance->capture)
+		instance->capture->record(now, src, E131_PORT, data, len);
+	instance->e131Packet(data, len, src, now);
+}
+
+void DmxInput::artnetReceive(const uint8_t* data, uint16_t len, const struct sockaddr_in* src)
+{
+	uint64_t now = statsNow();
+	if(instance->capture)
+		instance->capture->record(now, src, ARTNET_PORT, data, len);
+	instance->artnetPacket(data, len, src, now);
+}
+
+void DmxInput::receive(uint16_t port, const uint8_t* data, uint16_t len, const struct sockaddr_in* src, uint64_t now)
+{
+	if(port == E131_PORT)
+		e131Packet(data, len, src, now);
+	else if(port == ARTNET_PORT)
+		artnetPacket(data, len, src, now);
+}
+
+void DmxInput::e131Packet(const uint8_t* data, uint16_t len, const struct sockaddr_in* src, uint64_t now)
+{
+	if(len < E131_SYNC_SIZE || memcmp(data + 4, "ASC-E1.17\0\0\0", 12) != 0)
+	{
+		statsAdd(stats.dmx_errors, 1);
+		return;
+	}
+	if(!sources->admit(src, len, now))
+		return;
+
+	uint32_t root_vector = readUint32(data + 18);
+	uint32_t framing_vector = readUint32(data + 40);
+	if(root_vector == 8 && framing_vector == 1)
+	{
+		sync();
+		return;
+	}
+	if(root_vector != 4 || framing_vector != 2 || len < E131_DATA_OFFSET)
+	{
+		statsAdd(stats.dmx_errors, 1);
+		return;
+	}
+
+	uint8_t options = data[112];
+	uint16_t count = (data[123] << 8) | data[124];
+	// preview data is for desk monitors, a terminated stream carries no new data
+	// and only start code 0 holds dimmer levels
+	if((options & 0x60) || data[125] != 0 || count < 1 || len < E131_DATA_OFFSET + count - 1)
+		return;
+	bool sync = data[109] || data[110];
+	universe((data[113] << 8) | data[114], data + E131_DATA_OFFSET, count - 1, sync);
+}
+
+void DmxInput::artnetPacket(const uint8_t* data, uint16_t len, const struct sockaddr_in* src, uint64_t now)
+{
+	if(len < 10 || memcmp(data, "Art-Net\0", 8) != 0)
+	{
+		statsAdd(stats.dmx_errors, 1);
+		return;
+	}
+	uint16_t opcode = data[8] | (data[9] << 8);
+	// polls and everything else are not answered, the board only listens
+	if(opcode != 0x5000 && opcode != 0x5200)
+		return;
+	if(!sources->admit(src, len, now))
+		return;
+
+	if(opcode == 0x5200)
+	{
+		artnet_synced_at = now;
+		sync();
+		return;
+	}
+	if(len < ARTNET_DATA_OFFSET)
+	{
+		statsAdd(stats.dmx_errors, 1);
+		return;
+	}
+	uint16_t count = (data[16] << 8) | data[17];
+	if(len < ARTNET_DATA_OFFSET + count)
+	{
+		statsAdd(stats.dmx_errors, 1);
+		return;
+	}
+	// an ArtSync within the timeout means the sender syncs its output
+	bool sync = artnet_synced_at && now - artnet_synced_at < DMX_SYNC_TIMEOUT_NS;
+	universe(((data[15] & 0x7f) << 8) | data[14], data + ARTNET_DATA_OFFSET, count, sync);
+}
+
+// copy the channels of a universe to every span it is mapped to
+void DmxInput::universe(uint16_t universe, const uint8_t* data, uint16_t len, bool sync)
+{
+	statsAdd(stats.dmx_universes, 1);
+	uint32_t matches = 0;
+	for(int i = 0; i < mapping_count; i++)
+	{
+		if(mappings[i].universe == universe)
+			matches |= 1u << i;
+	}
+	if(!matches)
+	{
+		statsAdd(stats.dmx_universes_unmapped, 1);
+		return;
+	}
+
+	// without sync packets a frame is done when all its universes arrived, or when the
+	// sender starts over before that because it does not send all of them
+	if(!sync && (received & matches))
+		writeFrame();
+
+	received |= matches;
+	for(int i = 0; i < mapping_count; i++)
+	{
+		if(matches & (1u << i))
+			board->drawSpan(mappings[i].pixel, data, len < mappings[i].count ? len : mappings[i].count);
+	}
+
+	uint32_t all = mapping_count == 32 ? 0xffffffff : (1u << mapping_count) - 1;
+	if(!sync && received == all)
+		writeFrame();
+}
+
+void DmxInput::sync()
+{
+	statsAdd(stats.dmx_syncs, 1);
+	writeFrame();
+}
+
+void DmxInput::writeFrame()
+{
+	received = 0;
+	statsAdd(stats.dmx_frames, 1);
+	// in double buffer mode the universes are drawn into the back buffer
+	board->flip();
+	callback();
+}
@@ -0,0 +1,74 @@
+#ifndef _DMX_INPUT_H_
+#define _DMX_INPUT_H_
+
+#include <stdint.h>
+#include "Capture.h"
+#include "EventLoop.h"
+#include "LedBoard.h"
+#include "SourceTable.h"
+#include "UdpReceiver.h"
+
+// udp ports of the lighting protocols
+#define E131_PORT 5568
+#define ARTNET_PORT 6454
+// number of universe mappings
+#define DMX_MAPPINGS_MAX 32
+// channels in a dmx universe
+#define DMX_CHANNELS 512
+
+// a universe, or part of it, copied to consecutive pixels
+struct DmxMapping
+{
+	uint16_t universe;
+	uint16_t pixel;
+	uint16_t count;
+};
+
+// receives sACN (E1.31) and Art-Net dmx universes and draws them straight into the board's buffer
+class DmxInput
+{
+public:
+	DmxInput() : loop(0), board(0), sources(0), callback(0), capture(0), mapping_count(0), received(0), artnet_synced_at(0) {};
+
+	// parse "universe=pixel[:count]", count defaults to a whole universe
+	bool addMapping(const char* rule);
+	// without sockets, for replaying a capture through receive
+	void attach(LedBoard* board, SourceTable* sources, FrameCallback callback);
+	// capture may be 0, otherwise every received datagram is recorded to it
+	bool open(EventLoop* loop, LedBoard* board, SourceTable* sources, FrameCallback callback, CaptureWriter* capture);
+	// handle a datagram received on port E131_PORT or ARTNET_PORT at time now
+	void receive(uint16_t port, const uint8_t* data, uint16_t len, const struct sockaddr_in* src, uint64_t now);
+
+	int mappingCount() { return mapping_count; }
+
+private:
+	EventLoop* loop;
+	LedBoard* board;
+	SourceTable* sources;
+	FrameCallback callback;
+	CaptureWriter* capture;
+	UdpReceiver e131;
+	UdpReceiver artnet;
+
+	DmxMapping mappings[DMX_MAPPINGS_MAX];
+	int mapping_count;
+	// mappings updated since the last frame, by index
+	uint32_t received;
+	// last ArtSync, while they arrive frames are only written on a sync
+	// sACN marks the universes that wait for a sync itself
+	uint64_t artnet_synced_at;
+
+	static DmxInput* instance;
+	static void e131Event(int fd, uint32_t events, void* ctx);
+	static void artnetEvent(int fd, uint32_t events, void* ctx);
+	static void e131Receive(const uint8_t* data, uint16_t len, const struct sockaddr_in* src);
+	static void artnetReceive(const uint8_t* data, uint16_t len, const struct sockaddr_in* src);
+
+	void e131Packet(const uint8_t* data, uint16_t len, const struct sockaddr_in* src, uint64_t now);
+	void artnetPacket(const uint8_t* data, uint16_t len, const struct sockaddr_in* src, uint64_t now);
+	void universe(uint16_t universe, const uint8_t* data, uint16_t len, bool sync);
+	void sync();
+	void writeFrame();
+};
+
+#endif //_DMX_INPUT_H_
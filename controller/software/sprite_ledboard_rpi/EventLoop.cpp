@@ -0,0 +1,161 @@
+#include "EventLoop.h"
+#include "defines.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+bool EventLoop::init()
+{
+	for(int i = 0; i < EVENT_LOOP_MAX_HANDLERS; i++)
+	{
+		handlers[i].fd = -1;
+	}
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd < 0)
+	{
+		printf("Error creating epoll instance!\n");
+		return false;
+	}
+	return true;
+}
+
+EventLoop::Handler* EventLoop::findHandler(int fd)
+{
+	for(int i = 0; i < EVENT_LOOP_MAX_HANDLERS; i++)
+	{
+		if(handlers[i].fd == fd) return &handlers[i];
+	}
+	return 0;
+}
+
+EventLoop::Handler* EventLoop::allocHandler(int fd)
+{
+	if(fd < 0 || findHandler(fd)) return 0;
+	Handler* handler = findHandler(-1);
+	if(!handler) return 0;
+	memset(handler, 0, sizeof *handler);
+	handler->fd = fd;
+	return handler;
+}
+
+bool EventLoop::addFd(int fd, uint32_t events, EventCallback callback, void* ctx)
+{
+	Handler* handler = allocHandler(fd);
+	if(!handler) return false;
+	handler->events = events;
+	handler->event_callback = callback;
+	handler->ctx = ctx;
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof ev);
+	ev.events = events;
+	ev.data.ptr = handler;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		handler->fd = -1;
+		return false;
+	}
+	return true;
+}
+
+bool EventLoop::modifyFd(int fd, uint32_t events)
+{
+	Handler* handler = findHandler(fd);
+	if(!handler) return false;
+	if(handler->events == events) return true;
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof ev);
+	ev.events = events;
+	ev.data.ptr = handler;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0)
+		return false;
+	handler->events = events;
+	return true;
+}
+
+bool EventLoop::removeFd(int fd)
+{
+	Handler* handler = findHandler(fd);
+	if(!handler) return false;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, 0);
+	handler->fd = -1;
+	return true;
+}
+
+int EventLoop::addTimer(TimerCallback callback, void* ctx)
+{
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(fd < 0)
+	{
+		printf("Error creating timer!\n");
+		return -1;
+	}
+	if(!addFd(fd, EPOLLIN, 0, ctx))
+	{
+		close(fd);
+		return -1;
+	}
+	findHandler(fd)->timer_callback = callback;
+	return fd;
+}
+
+bool EventLoop::setTimer(int timer, uint64_t initial_ns, uint64_t interval_ns)
+{
+	struct itimerspec spec;
+	spec.it_value.tv_sec = initial_ns / NS_PER_SEC;
+	spec.it_value.tv_nsec = initial_ns % NS_PER_SEC;
+	spec.it_interval.tv_sec = interval_ns / NS_PER_SEC;
+	spec.it_interval.tv_nsec = interval_ns % NS_PER_SEC;
+	return timerfd_settime(timer, 0, &spec, 0) == 0;
+}
+
+bool EventLoop::removeTimer(int timer)
+{
+	if(!removeFd(timer)) return false;
+	close(timer);
+	return true;
+}
+
+int EventLoop::runOnce(int timeout_ms)
+{
+	struct epoll_event events[EVENT_LOOP_MAX_HANDLERS];
+	int count = epoll_wait(epoll_fd, events, EVENT_LOOP_MAX_HANDLERS, timeout_ms);
+	if(count < 0)
+	{
+		return errno == EINTR ? 0 : -1;
+	}
+	for(int i = 0; i < count; i++)
+	{
+		Handler* handler = (Handler*)events[i].data.ptr;
+		// removed by an earlier handler in this batch
+		if(handler->fd < 0) continue;
+
+		if(handler->timer_callback)
+		{
+			uint64_t expirations;
+			if(read(handler->fd, &expirations, sizeof expirations) == sizeof expirations)
+				handler->timer_callback(expirations, handler->ctx);
+		}
+		else
+		{
+			handler->event_callback(handler->fd, events[i].events, handler->ctx);
+		}
+	}
+	return count;
+}
+
+void EventLoop::run()
+{
+	running = true;
+	while(running)
+	{
+		if(runOnce(-1) < 0)
+		{
+			printf("Event loop error!\n");
+			break;
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef _EVENT_LOOP_H_
+#define _EVENT_LOOP_H_
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// maximum number of file descriptors and timers watched by the loop
+#define EVENT_LOOP_MAX_HANDLERS 32
+
+// called when fd is ready, events is the epoll event mask
+typedef void (*EventCallback)(int fd, uint32_t events, void* ctx);
+// called when a timer expires, expirations is the number of periods since the last call
+typedef void (*TimerCallback)(uint64_t expirations, void* ctx);
+
+class EventLoop
+{
+public:
+	EventLoop() : epoll_fd(-1), running(false) {};
+	~EventLoop() {};
+
+	bool init();
+
+	// watch a file descriptor, events is a mask of EPOLLIN / EPOLLOUT
+	bool addFd(int fd, uint32_t events, EventCallback callback, void* ctx);
+	bool modifyFd(int fd, uint32_t events);
+	bool removeFd(int fd);
+
+	// create a timer, returns the timer id (a timerfd) or -1 on error
+	// the timer is disarmed until setTimer is called
+	int addTimer(TimerCallback callback, void* ctx);
+	// arm a timer, fires after initial_ns and then every interval_ns (0: once)
+	// an initial_ns of 0 disarms the timer
+	bool setTimer(int timer, uint64_t initial_ns, uint64_t interval_ns);
+	bool removeTimer(int timer);
+
+	// dispatch events until stop is called
+	void run();
+	// wait at most timeout_ms (-1: forever) and dispatch the ready events
+	int runOnce(int timeout_ms);
+	void stop() { running = false; }
+
+private:
+	struct Handler
+	{
+		int fd;
+		uint32_t events;
+		EventCallback event_callback;
+		TimerCallback timer_callback;
+		void* ctx;
+	};
+
+	int epoll_fd;
+	bool running;
+	Handler handlers[EVENT_LOOP_MAX_HANDLERS];
+
+	Handler* findHandler(int fd);
+	Handler* allocHandler(int fd);
+};
+
+#endif //_EVENT_LOOP_H_
@@ -0,0 +1,44 @@
+#ifndef _FRAME_RING_H_
+#define _FRAME_RING_H_
+
+#include <stdint.h>
+
+// shared memory layout for local producers, see ShmInput.cpp and ShmProducer.cpp
+//
+// the producer writes frames straight into the slots, the controller encodes the newest
+// published slot for the serial port without copying it first. every slot is a seqlock:
+// its sequence is odd while the producer writes it, so the controller can tell when a slot
+// was overwritten while it was being read.
+//
+// the producer connects to the abstract unix socket "\0ledboard-<name>" once and receives
+// an eventfd, writing to it after publishing wakes up the controller.
+
+#define FRAME_RING_MAGIC 0x4c424652
+#define FRAME_RING_VERSION 1
+#define FRAME_RING_SLOTS 4
+#define FRAME_RING_WIDTH 96
+#define FRAME_RING_HEIGHT 48
+
+struct FrameSlot
+{
+	uint32_t sequence;
+	uint32_t reserved;
+	uint64_t frame;
+	uint8_t pixels[FRAME_RING_WIDTH * FRAME_RING_HEIGHT];
+};
+
+struct FrameRing
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint16_t width;
+	uint16_t height;
+	// number of frames published, the newest is in slot (published - 1) % slot_count
+	uint64_t published;
+	// aligned so header updates and pixel writes do not share a cache line
+	uint8_t padding[40];
+	FrameSlot slots[FRAME_RING_SLOTS];
+};
+
+#endif //_FRAME_RING_H_
@@ -1,11 +1,15 @@
 #include "LedBoard.h"
 #include "font7x5.h"
 #include "defines.h"
+#include "Stats.h"
 #include <string.h>
 #include <stdio.h>
 #include <termios.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
 
 
 /*
@@ -24,7 +28,18 @@ Commands:
 	0x01: write buffer, writes the current framebuffer to the screem
 		no arguments
 	0x02: clear, clears the matrix and writes the current framebuffer to the screen
+		in double buffer mode both the front and the back buffer are cleared
 		no arguments
+	0x03: flip, swaps the front and back buffer and writes the new front buffer to the screen
+		in single buffer mode this is the same as 0x01
+		no arguments
+	0x04: buffer mode
+		* uint8_t mode:
+			0: single buffer, drawing commands write to the displayed buffer (default)
+			1: double buffer, drawing commands write to the back buffer, 0x01 only
+			   writes the front buffer, 0x03 makes the back buffer visible
+			2: double buffer, and copy the front buffer to the back buffer after a flip
+			   so the next frame can be drawn incrementally
 	0x10: draw rows
 		* uint y:
 			y position of the row to draw (0-5)
@@ -41,6 +56,23 @@ Commands:
 			height of pixel data
 		* uint8_t data[width * height]:
 			pixel data
+	0x12: draw scaled image rectangle
+		* uint8_t x:
+			top left x position of the destination rectangle
+		* uint8_t y:
+			top left y position of the destination rectangle
+		* uint8_t width:
+			width of the destination rectangle
+		* uint8_t height:
+			height of the destination rectangle
+		* uint8_t src_width:
+			width of pixel data
+		* uint8_t src_height:
+			height of pixel data
+		* uint8_t mode:
+			resampling filter, 0: nearest, 1: box (average), 2: bilinear
+		* uint8_t data[src_width * src_height]:
+			pixel data
 	0x20: write text line based
 		chars are 5x7 -> 6x8 including space and line separation
 		* uint8_t x:
@@ -64,6 +96,127 @@ Commands:
 			text (ascii)
 		* 0x00:
 			terminator
+	0x30: fill rectangle
+		* uint8_t x, y:
+			top left position in pixels
+		* uint8_t width, height:
+			size of the rectangle
+		* uint8_t brightness:
+			fill value
+	0x31: fill rectangle with a gradient
+		* uint8_t x, y:
+			top left position in pixels
+		* uint8_t width, height:
+			size of the rectangle
+		* uint8_t from, to:
+			brightness at the start and end of the gradient
+		* uint8_t direction:
+			0: left to right, 1: top to bottom
+	0x32: draw horizontal line
+		* uint8_t x, y:
+			start position in pixels
+		* uint8_t length:
+			length of the line towards the right
+		* uint8_t brightness
+	0x33: draw vertical line
+		* uint8_t x, y:
+			start position in pixels
+		* uint8_t length:
+			length of the line downwards
+		* uint8_t brightness
+	0x34: draw line
+		* uint8_t x0, y0:
+			start position in pixels
+		* uint8_t x1, y1:
+			end position in pixels
+		* uint8_t brightness
+	0x35: draw rectangle outline
+		* uint8_t x, y:
+			top left position in pixels
+		* uint8_t width, height:
+			size of the rectangle
+		* uint8_t brightness
+	0x36: draw circle
+		* uint8_t x, y:
+			center position in pixels
+		* uint8_t radius
+		* uint8_t brightness
+		* uint8_t filled:
+			0: outline only, 1: filled
+	0x40: fragment, part of a block of commands that is too large for one datagram
+		multi byte values are big endian
+		* uint16_t frame_id:
+			identifies the block, increment it for every block
+		* uint16_t offset:
+			position of this fragment in the block
+		* uint16_t total_length:
+			length of the complete block (max 8192)
+		* uint16_t length:
+			length of the data in this fragment
+		* uint8_t data[length]:
+			part of the block
+		the fragments are collected in a staging buffer. once all bytes of the block
+		have arrived the block is processed as if it were a single datagram.
+		fragments of an older frame_id are ignored, an incomplete block is discarded
+		when a fragment of a newer block arrives or when it is not completed within
+		200 ms. a block can not contain fragments itself.
+	0x50: clock request, for scheduling frames with 0x51
+		* uint64_t cookie:
+			any value, returned in the reply
+		the controller replies to the sender with 0x50, the cookie and
+		uint64_t time: the controller clock in microseconds (monotonic, not wall clock time)
+		a sender estimates the offset to its own clock as
+		time - (sent + received) / 2, and keeps the reply with the shortest round trip
+	0x51: present at, queue the back buffer to be shown at a later time
+		only in double buffer mode, the back buffer stays as it was drawn
+		* uint64_t time:
+			presentation time on the controller clock in microseconds
+		up to 8 frames wait in a jitter buffer and are written in order of their time,
+		so frames that arrive in bursts are still shown at a steady rate.
+		a frame that is due while an earlier one was not shown yet replaces it, a frame
+		that arrives after its time is shown right away and counted as late.
+		frames more than 2 s ahead are dropped, the sender's clock offset is wrong.
+	0x52: prepare frame, keep a copy of the back buffer until it is presented with 0x53
+		only in double buffer mode, the back buffer stays as it was drawn
+		* uint32_t frame:
+			frame number, increment it for every frame
+	0x53: present frame, show the prepared frame
+		* uint32_t frame:
+			frame number given to 0x52, nothing is shown if a different frame was prepared
+		* uint64_t time:
+			time the sync was sent in microseconds on the sender's clock, only reported
+		boards that form one sign all get their part with 0x52, then a single 0x53 is sent
+		to the multicast group 239.255.13.37 port 1339 so all boards start the frame at
+		the same moment. each board reports the time from the sync to the start of the
+		frame and the monotonic time the frame started, on one host those can be compared
+		to find the skew between boards.
+	0x54: status request, for senders that pace themselves to the serial link
+		no arguments
+		the controller replies to the sender with 0x54 and
+		* uint32_t generation:
+			number of frames started on the serial link, increments with every frame
+		* uint8_t queue_depth:
+			frames not completely written, 0: idle, 1: transmitting, 2: one more waiting
+		* uint8_t credits:
+			frames that can be written now without one replacing another, 2 - queue_depth
+		* uint8_t jitter_free:
+			free slots in the jitter buffer of 0x51
+		* uint32_t idle_us:
+			estimated time until the serial link is idle, in microseconds
+		* uint16_t fps:
+			frames completed per second over the last second, times 100
+		a sender that waits for a credit before writing a frame, and keeps an eye on
+		idle_us, sends as fast as the board can show frames without losing any.
+	0x60: set brightness of the whole board
+		* uint8_t level:
+			0x00 (off) - 0xFF (full), applied by the segments to every frame
+		only 2 bytes are sent to the segments, the frame is not sent again
+	0x61: fade brightness of the whole board
+		* uint8_t level:
+			brightness at the end of the fade
+		* uint16_t duration:
+			length of the fade in milliseconds, at most 10400
+		the segments fade by themselves, the duration is rounded to a multiple of 82 ms
 	
 */
 
@@ -92,16 +245,45 @@ int LedBoard::panel_layout[PANEL_COUNT][2] = {
 
 // size of board for buffers
 #define TOTAL_SIZE (X_SIZE * Y_SIZE)
+// size of the transmit buffer, a reset byte, a phase sync, the frame and a latch byte
+#define TX_BUFFER_SIZE (3 + TOTAL_SIZE)
+// period the frame rate in the status reply is taken over
+#define TX_FPS_WINDOW_NS NS_PER_SEC
+
+// largest block that can be sent in fragments
+#define FRAGMENT_BLOCK_SIZE 8192
+// incomplete blocks older than this are discarded
+#define FRAGMENT_TIMEOUT_NS (200 * NS_PER_MS)
+
+// refresh rate of the segments, and the refreshes in a step of a segment fade
+#define SEGMENT_REFRESH_HZ 195
+#define SEGMENT_FADE_STEP 16
+#define SEGMENT_FADE_STEPS_MAX 127
+
+// frames shown later than this after their presentation time are counted as late
+#define JITTER_LATE_NS (2 * NS_PER_MS)
+// frames scheduled further ahead are dropped
+#define JITTER_MAX_AHEAD_NS (2 * NS_PER_SEC)
 
 int LedBoard::width = X_SIZE;
 int LedBoard::height = Y_SIZE;
-// buffer that can be written to the matrix
-uint8_t LedBoard::buffer[TOTAL_SIZE];
+// front and back buffer that can be written to the matrix, and the page a shared memory
+// frame is copied into while it is encoded
+uint8_t LedBoard::pages[3 * TOTAL_SIZE];
 // buffer, set at init, keeps track of pixel location to pixel order to send to panels
 uint16_t LedBoard::pixel_map[TOTAL_SIZE];
+// encoded frame that is being written to the serial port
+uint8_t LedBoard::tx_buffer[TX_BUFFER_SIZE];
+// staging buffer for fragmented blocks, and which of its bytes have arrived
+uint8_t LedBoard::fragment_buffer[FRAGMENT_BLOCK_SIZE];
+uint8_t LedBoard::fragment_received[FRAGMENT_BLOCK_SIZE];
+// frames waiting for their presentation time
+uint8_t LedBoard::jitter_pages[JITTER_SLOTS * TOTAL_SIZE];
+// frame prepared for a sync pulse
+uint8_t LedBoard::sync_page[TOTAL_SIZE];
 
-// initialize the pixel map and the serial port
-void LedBoard::init()
+// initialize the pixel map and the serial port, or no output for device 0
+void LedBoard::init(const char* device)
 {
 	int pos = 0;
 	for(int i = 0; i < PANEL_COUNT; i++)
@@ -120,28 +302,60 @@ void LedBoard::init()
 		}
 	}
 
-	fd = fopen("/dev/ttyAMA0", "w");
-	if(!fd)
+	// the page after front and back
+	external = pages + 2 * TOTAL_SIZE;
+
+	tx_len = tx_pos = 0;
+	tx_queued = false;
+	tx_generation = 0;
+	tx_history_pos = 0;
+	memset(tx_history, 0, sizeof tx_history);
+	tx_commands_len = tx_commands_pos = 0;
+
+	fragment_active = false;
+	fragment_done = false;
+	fragment_applying = false;
+
+	jitter_count = 0;
+
+	sync_prepared = false;
+	sync_pending = false;
+
+	// no device: frames are dropped as if they were written, for host tools
+	if(!device)
+	{
+		fd = -1;
+		return;
+	}
+
+	// writes never block, the event loop flushes the transmit buffer when the port is writable
+	fd = open(device, O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY | O_NONBLOCK, 0644);
+	if(fd < 0)
 	{
-		printf("Error opening serial port!");
+		printf("Error opening serial port!\n");
 		exit(1);
 	}
 
-	int fd2 = fileno(fd);
-	struct termios options;
-	tcgetattr(fd2, &options);
-	cfsetispeed(&options, B500000);
-	cfsetospeed(&options, B500000);
-	tcsetattr(fd2, TCSANOW, &options);
+	// anything that is not a tty (a file, a pipe) is written as is
+	if(isatty(fd))
+	{
+		struct termios options;
+		tcgetattr(fd, &options);
+		cfmakeraw(&options);
+		cfsetispeed(&options, B500000);
+		cfsetospeed(&options, B500000);
+		tcsetattr(fd, TCSANOW, &options);
+	}
 
 //	Serial1.begin(BAUDRATE);
 }
 
-// clear the whole board
+// clear the whole board, both pages in double buffer mode so the screen goes dark too
 void LedBoard::clear()
 {
 	memset(buffer, 0, width * height);
-	outputStart();
+	if(front != buffer)
+		memset(front, 0, width * height);
 	writeBuffer();
 }
 
@@ -149,11 +363,16 @@ void LedBoard::clear()
 bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 {
 	uint16_t packet_position = 0;
+	uint8_t cmd = 0;
+	// time the commands of one in STATS_SAMPLE_RATE packets
+	static uint32_t packet_count;
+	bool timed = (packet_count++ & (STATS_SAMPLE_RATE - 1)) == 0;
+	uint64_t start = timed ? statsNow() : 0;
 	// as long as there is data still...
 	while(packet_position < packet_len)
 	{
 		// first byte is command
-		uint8_t cmd = data[packet_position++];
+		cmd = data[packet_position++];
 		#ifdef DEBUG
 		Serial.print("Packet: ");
 		Serial.print(cmd, HEX);
@@ -172,16 +391,32 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 				clear();
 				break;
 
+			// flip
+			case 0x03:
+				flip();
+				break;
+
+			// buffer mode
+			case 0x04:
+				if(packet_len - packet_position < 1)
+					goto packet_error;
+				if(!setBufferMode(data[packet_position++]))
+					goto packet_error;
+				break;
+
 			// draw rows
 			case 0x10:
 			{
 				// need 1 byte for y and 96 * 8 for pixel data
 				if(packet_len - packet_position < 1 + (96 * 8))
-					return false;
+					goto packet_error;
 
 				uint8_t y = data[packet_position++];
 
-				packet_position += drawImage(0, y * 8, 96, 8, (uint8_t*)data + packet_position);
+				// rows below the board are skipped, y * 8 would wrap around to the top
+				if(y < Y_SIZE / 8)
+					drawImage(0, y * 8, 96, 8, (uint8_t*)data + packet_position);
+				packet_position += 96 * 8;
 
 				break;
 			}
@@ -190,7 +425,7 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 			{
 				// 4 bytes for header
 				if(packet_len - packet_position < 4)
-					return false;
+					goto packet_error;
 				uint8_t x = data[packet_position++];
 				uint8_t y = data[packet_position++];
 				uint8_t width = data[packet_position++];
@@ -198,12 +433,37 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 
 				// need enough bytes 
 				if(packet_len - packet_position < width * height)
-					return false;
+					goto packet_error;
 
 				packet_position += drawImage(x, y, width, height, (uint8_t*)(data + packet_position));
 				
 				break;
 			}
+			// draw scaled image rectangle
+			case 0x12:
+			{
+				// 7 bytes for header
+				if(packet_len - packet_position < 7)
+					goto packet_error;
+				uint8_t x = data[packet_position++];
+				uint8_t y = data[packet_position++];
+				uint8_t width = data[packet_position++];
+				uint8_t height = data[packet_position++];
+				uint8_t src_width = data[packet_position++];
+				uint8_t src_height = data[packet_position++];
+				uint8_t mode = data[packet_position++];
+
+				if(mode > SCALE_BILINEAR)
+					goto packet_error;
+
+				// need enough bytes
+				if(packet_len - packet_position < src_width * src_height)
+					goto packet_error;
+
+				packet_position += drawScaledImage(x, y, width, height, src_width, src_height, mode, data + packet_position);
+
+				break;
+			}
 
 			// write text line based
 			case 0x20:
@@ -211,28 +471,279 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 			case 0x21:
 			{
 				bool absolute = cmd == 0x21;
+				// 3 bytes for header
+				if(packet_len - packet_position < 3)
+					goto packet_error;
 				uint8_t x = data[packet_position++];
 				uint8_t y = data[packet_position++];
 				uint8_t brightness = data[packet_position++];
-				int16_t str_size = strnlen((char*)(data + packet_position), packet_len - packet_position);
-				// string error
-				if(str_size < 0)
-					return false;
-				packet_position += drawString(
+				// the text ends at the terminator, or at the end of the packet
+				uint16_t str_size = strnlen((char*)(data + packet_position), packet_len - packet_position);
+				drawString(
 					(char*)(data + packet_position), 
 					str_size, 
 					x, y, 
 					brightness,
 					absolute
 				);
+				packet_position += str_size;
+				if(packet_position < packet_len)
+					packet_position++;
+				break;
+			}
+			// fill rectangle
+			case 0x30:
+			{
+				if(packet_len - packet_position < 5)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				fillRect(args[0], args[1], args[2], args[3], args[4]);
+				break;
+			}
+			// fill rectangle with a gradient
+			case 0x31:
+			{
+				if(packet_len - packet_position < 7)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 7;
+				fillGradient(args[0], args[1], args[2], args[3], args[4], args[5], args[6] != 0);
+				break;
+			}
+			// draw horizontal line
+			case 0x32:
+			// draw vertical line
+			case 0x33:
+			{
+				if(packet_len - packet_position < 4)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 4;
+				if(cmd == 0x32)
+					fillRect(args[0], args[1], args[2], 1, args[3]);
+				else
+					fillRect(args[0], args[1], 1, args[2], args[3]);
+				break;
+			}
+			// draw line
+			case 0x34:
+			{
+				if(packet_len - packet_position < 5)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				drawLine(args[0], args[1], args[2], args[3], args[4]);
+				break;
+			}
+			// draw rectangle outline
+			case 0x35:
+			{
+				if(packet_len - packet_position < 5)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				drawRect(args[0], args[1], args[2], args[3], args[4]);
+				break;
+			}
+			// draw circle
+			case 0x36:
+			{
+				if(packet_len - packet_position < 5)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				drawCircle(args[0], args[1], args[2], args[3], args[4] != 0);
+				break;
+			}
+			// fragment
+			case 0x40:
+			{
+				// 8 bytes for header
+				if(packet_len - packet_position < 8)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 8;
+				uint16_t frame_id = (args[0] << 8) | args[1];
+				uint16_t offset = (args[2] << 8) | args[3];
+				uint16_t total_length = (args[4] << 8) | args[5];
+				uint16_t length = (args[6] << 8) | args[7];
+
+				if(packet_len - packet_position < length)
+					goto packet_error;
+				if(!processFragment(frame_id, offset, total_length, data + packet_position, length))
+					goto packet_error;
+				packet_position += length;
+				break;
+			}
+			// clock request
+			case 0x50:
+			{
+				if(packet_len - packet_position < 8)
+					goto packet_error;
+				uint8_t reply_data[17];
+				reply_data[0] = 0x50;
+				memcpy(reply_data + 1, data + packet_position, 8);
+				packet_position += 8;
+				writeUint64(reply_data + 9, statsNow() / 1000);
+				if(reply)
+					reply(reply_data, sizeof reply_data);
+				break;
+			}
+			// present at
+			case 0x51:
+			{
+				if(packet_len - packet_position < 8)
+					goto packet_error;
+				if(buffer_mode == BUFFER_SINGLE)
+					goto packet_error;
+				uint64_t time = readUint64(data + packet_position);
+				packet_position += 8;
+				schedule(time * 1000);
+				break;
+			}
+			// prepare frame
+			case 0x52:
+			{
+				if(packet_len - packet_position < 4)
+					goto packet_error;
+				if(buffer_mode == BUFFER_SINGLE)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 4;
+				if(sync_prepared)
+					statsAdd(stats.sync_frames_unused, 1);
+				sync_frame = ((uint32_t)args[0] << 24) | (args[1] << 16) | (args[2] << 8) | args[3];
+				sync_prepared = true;
+				memcpy(sync_page, buffer, TOTAL_SIZE);
+				break;
+			}
+			// present frame
+			case 0x53:
+			{
+				if(packet_len - packet_position < 12)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 12;
+				uint32_t frame = ((uint32_t)args[0] << 24) | (args[1] << 16) | (args[2] << 8) | args[3];
+				presentPrepared(frame, readUint64(args + 4));
+				break;
+			}
+			// status request
+			case 0x54:
+			{
+				uint8_t reply_data[14];
+				encodeStatus(reply_data);
+				if(reply)
+					reply(reply_data, sizeof reply_data);
+				break;
+			}
+			// brightness
+			case 0x60:
+			{
+				if(packet_len - packet_position < 1)
+					goto packet_error;
+				setBrightness(data[packet_position++]);
+				break;
+			}
+			// fade
+			case 0x61:
+			{
+				if(packet_len - packet_position < 3)
+					goto packet_error;
+				const uint8_t* args = data + packet_position;
+				packet_position += 3;
+				fadeBrightness(args[0], (args[1] << 8) | args[2]);
 				break;
 			}
 			// unknown command -> ignore this packet
 			default:
-				return false;
+				goto packet_error;
+		}
+		statsAdd(stats.commands[cmd], 1);
+		if(timed)
+		{
+			uint64_t end = statsNow();
+			statsRecord(stats.command_time[cmd], end - start);
+			start = end;
 		}
 	}
 	return true;
+
+packet_error:
+	statsAdd(stats.parse_errors[cmd], 1);
+	return false;
+}
+
+
+// collect a fragment, process the block once it is complete
+// returns false for fragments that can never be part of a valid block
+bool LedBoard::processFragment(uint16_t frame_id, uint16_t offset, uint16_t total_length, const uint8_t* data, uint16_t length)
+{
+	if(fragment_applying)
+		return false;
+	if(total_length == 0 || total_length > FRAGMENT_BLOCK_SIZE || offset + length > total_length)
+		return false;
+
+	uint64_t now = statsNow();
+	// after a timeout any frame_id is accepted, so a restarted sender is not ignored
+	bool recent = now - fragment_start <= FRAGMENT_TIMEOUT_NS;
+	if(fragment_active)
+	{
+		// a fragment of an older block, ignore it
+		if((int16_t)(frame_id - fragment_id) < 0 && recent)
+		{
+			statsAdd(stats.fragments_stale, 1);
+			return true;
+		}
+		// a newer block, or the current one took too long
+		if(frame_id != fragment_id || now - fragment_start > FRAGMENT_TIMEOUT_NS || total_length != fragment_length)
+		{
+			statsAdd(stats.fragment_blocks_discarded, 1);
+			fragment_active = false;
+			fragment_done = true;
+		}
+	}
+
+	if(!fragment_active && fragment_done && recent && (int16_t)(frame_id - fragment_id) <= 0)
+	{
+		// duplicate of a block that was already applied or discarded
+		statsAdd(stats.fragments_stale, 1);
+		return true;
+	}
+
+	if(!fragment_active)
+	{
+		fragment_active = true;
+		fragment_done = false;
+		fragment_id = frame_id;
+		fragment_length = total_length;
+		fragment_missing = total_length;
+		fragment_start = now;
+		memset(fragment_received, 0, total_length);
+	}
+
+	statsAdd(stats.fragments_received, 1);
+	memcpy(fragment_buffer + offset, data, length);
+	for(uint16_t i = offset; i < offset + length; i++)
+	{
+		fragment_missing -= !fragment_received[i];
+		fragment_received[i] = 1;
+	}
+
+	if(fragment_missing == 0)
+	{
+		fragment_active = false;
+		fragment_done = true;
+		fragment_start = now;
+		statsAdd(stats.fragment_blocks_completed, 1);
+
+		fragment_applying = true;
+		bool success = processPacket(fragment_buffer, fragment_length);
+		fragment_applying = false;
+		return success;
+	}
+	return true;
 }
 
 
@@ -243,8 +754,11 @@ uint16_t LedBoard::drawStringNoLen(char* text, uint8_t x_pos, uint8_t y_pos, uin
 
 
 // draw a string at x_pos, y_pos, optionally absolute position
-uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_pos, uint8_t y_pos, uint8_t brightness, bool absolute)
+uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_char, uint8_t y_char, uint8_t brightness, bool absolute)
 {
+	// in pixels, line based positions do not fit in a uint8_t
+	int x_pos = x_char;
+	int y_pos = y_char;
 	if(!absolute)
 	{
 		x_pos *= TEXT_CHAR_WIDTH + 1;
@@ -253,13 +767,14 @@ uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_pos, uint8_t y
 	if(x_pos + TEXT_CHAR_WIDTH >= width) goto writeText_exit;
 	if(y_pos + TEXT_CHAR_HEIGHT >= height) goto writeText_exit;
 
-	for(int i = 0; i < len; i++)
+	// characters past the right edge are not drawn
+	for(int i = 0; i < len && x_pos + (TEXT_CHAR_WIDTH + 1) * i < width; i++)
 	{
 		int char_pos = (text[i] - 0x20);
 		if(char_pos < 0 || char_pos > (0x7f - 0x20)) char_pos = 0;
 		char_pos *= TEXT_CHAR_WIDTH; // 5 byte per char
 
-		// draw 1 extra for the space, it's ok if it overflows there because setPixel will catch that
+		// draw 1 extra for the space, it's ok if it overflows there because setPixelClipped will catch that
 		for(int char_x = 0; char_x < TEXT_CHAR_WIDTH + 1; char_x++)
 		{
 			// this draws a 1 pixel empty column after each character
@@ -269,7 +784,7 @@ uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_pos, uint8_t y
 			for(int k = 0; k < TEXT_CHAR_HEIGHT + 1; k++)
 			{
 				bool on = (c & (1 << k)) != 0;
-				setPixel(
+				setPixelClipped(
 					on ? brightness : 0x00,
 					x_pos + char_x + ((TEXT_CHAR_WIDTH + 1) * i), 
 					y_pos + k
@@ -285,14 +800,274 @@ writeText_exit:
 // draws an image in the specified region
 uint16_t LedBoard::drawImage(uint8_t x, uint8_t y, uint16_t width, uint16_t height, uint8_t* data)
 {
-	for(int y_pos = 0; y_pos < height; y_pos++)
+	// copy the part of every row that is on the board, x + width used to wrap around
+	int visible = x < X_SIZE ? X_SIZE - x : 0;
+	if(visible > width) visible = width;
+	if(visible <= 0)
+		return width * height;
+	for(int y_pos = 0; y_pos < height && y + y_pos < Y_SIZE; y_pos++)
+	{
+		memcpy(buffer + (y + y_pos) * X_SIZE + x, data + y_pos * width, visible);
+	}
+	return width * height;
+}
+
+// draws an image of src_width * src_height resampled to fit the specified region
+// source coordinates are stepped in 16.16 fixed point, bilinear weights are 8 bit
+uint16_t LedBoard::drawScaledImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t src_width, uint8_t src_height, uint8_t mode, const uint8_t* data)
+{
+	uint16_t src_size = src_width * src_height;
+	if(width == 0 || height == 0 || src_size == 0)
+		return src_size;
+
+	// clip the destination rectangle to the board
+	int x_end = x + width > this->width ? this->width : x + width;
+	int y_end = y + height > this->height ? this->height : y + height;
+	if(x >= x_end || y >= y_end)
+		return src_size;
+
+	uint32_t x_step = ((uint32_t)src_width << 16) / width;
+	uint32_t y_step = ((uint32_t)src_height << 16) / height;
+
+	// per column source positions, computed once and reused for every row
+	uint8_t col_start[X_SIZE];
+	uint8_t col_end[X_SIZE];
+	uint8_t col_frac[X_SIZE];
+	for(int x_pos = x; x_pos < x_end; x_pos++)
 	{
-		for(int x_pos = 0; x_pos < width; x_pos++)
+		int i = x_pos - x;
+		scaleSpan(i, x_step, src_width, mode, &col_start[i], &col_end[i], &col_frac[i]);
+	}
+
+	for(int y_pos = y; y_pos < y_end; y_pos++)
+	{
+		uint8_t row_start, row_end, row_frac;
+		scaleSpan(y_pos - y, y_step, src_height, mode, &row_start, &row_end, &row_frac);
+
+		uint8_t* out = buffer + y_pos * this->width + x;
+		const uint8_t* row0 = data + row_start * src_width;
+		const uint8_t* row1 = data + row_end * src_width;
+		int count = x_end - x;
+
+		switch(mode)
 		{
-			setPixel(*data++, x + x_pos, y + y_pos);
+			case SCALE_NEAREST:
+				for(int i = 0; i < count; i++)
+					out[i] = row0[col_start[i]];
+				break;
+
+			case SCALE_BOX:
+			{
+				// row_end and col_end are exclusive here
+				uint16_t rows = row_end - row_start;
+				for(int i = 0; i < count; i++)
+				{
+					uint32_t sum = 0;
+					const uint8_t* src = row0;
+					for(uint16_t r = 0; r < rows; r++, src += src_width)
+					{
+						for(uint16_t c = col_start[i]; c < col_end[i]; c++)
+							sum += src[c];
+					}
+					out[i] = sum / (rows * (col_end[i] - col_start[i]));
+				}
+				break;
+			}
+
+			case SCALE_BILINEAR:
+				for(int i = 0; i < count; i++)
+				{
+					uint16_t fx = col_frac[i];
+					uint16_t top = row0[col_start[i]] * (256 - fx) + row0[col_end[i]] * fx;
+					uint16_t bottom = row1[col_start[i]] * (256 - fx) + row1[col_end[i]] * fx;
+					out[i] = ((uint32_t)top * (256 - row_frac) + (uint32_t)bottom * row_frac) >> 16;
+				}
+				break;
+		}
+	}
+	return src_size;
+}
+
+// map destination index i to the source samples for the given filter
+// nearest: start is the sample, end the same sample
+// box: [start, end) is the covered source range
+// bilinear: start and end are the neighbouring samples, frac the weight of end
+// all three are set for every mode
+void LedBoard::scaleSpan(int i, uint32_t step, uint8_t src_size, uint8_t mode, uint8_t* start, uint8_t* end, uint8_t* frac)
+{
+	*start = *end = *frac = 0;
+	switch(mode)
+	{
+		case SCALE_NEAREST:
+			// sample at the center of the destination pixel
+			*start = *end = (i * step + (step >> 1)) >> 16;
+			break;
+
+		case SCALE_BOX:
+		{
+			uint32_t s = (i * step) >> 16;
+			uint32_t e = ((i + 1) * step + 0xFFFF) >> 16;
+			if(e > src_size) e = src_size;
+			if(e <= s) e = s + 1;
+			*start = s;
+			*end = e;
+			break;
+		}
+
+		case SCALE_BILINEAR:
+		{
+			// center of destination pixel in source space, minus half a source pixel
+			int32_t pos = (int32_t)(i * step + (step >> 1)) - 0x8000;
+			if(pos < 0) pos = 0;
+			uint32_t s = pos >> 16;
+			if(s >= (uint32_t)src_size - 1)
+			{
+				*start = *end = src_size - 1;
+				*frac = 0;
+			}
+			else
+			{
+				*start = s;
+				*end = s + 1;
+				*frac = (pos >> 8) & 0xFF;
+			}
+			break;
+		}
+	}
+}
+
+// fill a rectangle with a single value, clipped to the board
+void LedBoard::fillRect(int x, int y, int width, int height, uint8_t val)
+{
+	if(x < 0) { width += x; x = 0; }
+	if(y < 0) { height += y; y = 0; }
+	if(x + width > this->width) width = this->width - x;
+	if(y + height > this->height) height = this->height - y;
+	if(width <= 0 || height <= 0) return;
+
+	uint8_t* row = buffer + y * this->width + x;
+	for(int i = 0; i < height; i++, row += this->width)
+	{
+		memset(row, val, width);
+	}
+}
+
+// fill a rectangle with a linear gradient from `from` to `to`
+void LedBoard::fillGradient(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t from, uint8_t to, bool vertical)
+{
+	int steps = (vertical ? height : width) - 1;
+	if(steps < 0) return;
+	int delta = to - from;
+
+	if(vertical)
+	{
+		// one value per row
+		for(int i = 0; i <= steps; i++)
+		{
+			uint8_t val = steps ? from + delta * i / steps : from;
+			fillRect(x, y + i, width, 1, val);
+		}
+		return;
+	}
+
+	// build the first visible row, then copy it to the rows below
+	int x_end = x + width > this->width ? this->width : x + width;
+	int y_end = y + height > this->height ? this->height : y + height;
+	if(x >= x_end || y >= y_end) return;
+
+	uint8_t* first = buffer + y * this->width;
+	for(int x_pos = x; x_pos < x_end; x_pos++)
+	{
+		int i = x_pos - x;
+		first[x_pos] = steps ? from + delta * i / steps : from;
+	}
+	for(int y_pos = y + 1; y_pos < y_end; y_pos++)
+	{
+		memcpy(buffer + y_pos * this->width + x, first + x, x_end - x);
+	}
+}
+
+// draw a line from x0, y0 to x1, y1 using bresenham
+void LedBoard::drawLine(int x0, int y0, int x1, int y1, uint8_t val)
+{
+	// straight lines are spans
+	if(y0 == y1)
+	{
+		if(x1 < x0) { int t = x0; x0 = x1; x1 = t; }
+		fillRect(x0, y0, x1 - x0 + 1, 1, val);
+		return;
+	}
+	if(x0 == x1)
+	{
+		if(y1 < y0) { int t = y0; y0 = y1; y1 = t; }
+		fillRect(x0, y0, 1, y1 - y0 + 1, val);
+		return;
+	}
+
+	int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+	int dy = y1 > y0 ? y0 - y1 : y1 - y0;
+	int sx = x0 < x1 ? 1 : -1;
+	int sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy;
+	while(1)
+	{
+		if(x0 >= 0 && x0 < width && y0 >= 0 && y0 < height)
+			buffer[y0 * width + x0] = val;
+		if(x0 == x1 && y0 == y1) break;
+		int e2 = 2 * err;
+		if(e2 >= dy) { err += dy; x0 += sx; }
+		if(e2 <= dx) { err += dx; y0 += sy; }
+	}
+}
+
+// draw the outline of a rectangle
+void LedBoard::drawRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t val)
+{
+	if(width == 0 || height == 0) return;
+	fillRect(x, y, width, 1, val);
+	fillRect(x, y + height - 1, width, 1, val);
+	fillRect(x, y + 1, 1, height - 2, val);
+	fillRect(x + width - 1, y + 1, 1, height - 2, val);
+}
+
+// draw a circle around x, y using the midpoint algorithm
+void LedBoard::drawCircle(int x, int y, int radius, uint8_t val, bool filled)
+{
+	int dx = radius;
+	int dy = 0;
+	int err = 1 - radius;
+	while(dx >= dy)
+	{
+		if(filled)
+		{
+			// spans for the four octant pairs
+			fillRect(x - dx, y + dy, 2 * dx + 1, 1, val);
+			fillRect(x - dx, y - dy, 2 * dx + 1, 1, val);
+			fillRect(x - dy, y + dx, 2 * dy + 1, 1, val);
+			fillRect(x - dy, y - dx, 2 * dy + 1, 1, val);
+		}
+		else
+		{
+			setPixelClipped(val, x + dx, y + dy);
+			setPixelClipped(val, x - dx, y + dy);
+			setPixelClipped(val, x + dx, y - dy);
+			setPixelClipped(val, x - dx, y - dy);
+			setPixelClipped(val, x + dy, y + dx);
+			setPixelClipped(val, x - dy, y + dx);
+			setPixelClipped(val, x + dy, y - dx);
+			setPixelClipped(val, x - dy, y - dx);
+		}
+		dy++;
+		if(err < 0)
+		{
+			err += 2 * dy + 1;
+		}
+		else
+		{
+			dx--;
+			err += 2 * (dy - dx) + 1;
 		}
 	}
-	return width * height;
 }
 
 // render a WIDTH * HEIGHT XBM header
@@ -308,15 +1083,356 @@ void LedBoard::drawXBM(const uint8_t* data, uint16_t len)
 	}
 }
 
+// copy pixels to consecutive positions of the buffer, clipped at the end of the board
+void LedBoard::drawSpan(uint16_t pos, const uint8_t* data, uint16_t len)
+{
+	if(pos >= TOTAL_SIZE)
+		return;
+	if(len > TOTAL_SIZE - pos)
+		len = TOTAL_SIZE - pos;
+	memcpy(buffer + pos, data, len);
+}
+
 
-// draw the curent framebuffer on the screen
+// switch between single and double buffering
+bool LedBoard::setBufferMode(uint8_t mode)
+{
+	switch(mode)
+	{
+		case BUFFER_SINGLE:
+			buffer = front;
+			break;
+		case BUFFER_DOUBLE:
+		case BUFFER_DOUBLE_COPY:
+			if(buffer_mode == BUFFER_SINGLE)
+			{
+				// start drawing on top of what is currently shown, on the page that is
+				// neither the front nor the external one
+				buffer = pages;
+				while(buffer == front || buffer == external)
+					buffer += TOTAL_SIZE;
+				memcpy(buffer, front, TOTAL_SIZE);
+			}
+			break;
+		default:
+			return false;
+	}
+	buffer_mode = mode;
+	return true;
+}
+
+// commit the back buffer and draw it on the screen
+void LedBoard::flip()
+{
+	if(buffer_mode != BUFFER_SINGLE)
+	{
+		uint8_t* committed = buffer;
+		buffer = front;
+		front = committed;
+		if(buffer_mode == BUFFER_DOUBLE_COPY)
+			memcpy(buffer, front, TOTAL_SIZE);
+	}
+	writeBuffer();
+}
+
+
+// queue a copy of the back buffer for presentation at time (controller clock, ns)
+void LedBoard::schedule(uint64_t time)
+{
+	uint64_t now = statsNow();
+	if((int64_t)(time - now) > (int64_t)JITTER_MAX_AHEAD_NS || jitter_count == JITTER_SLOTS)
+	{
+		statsAdd(stats.jitter_frames_dropped, 1);
+		return;
+	}
+	statsAdd(stats.jitter_frames_scheduled, 1);
+
+	// keep the queue sorted by time, frames with the same time stay in arrival order
+	// the pages are not moved, only their slot numbers
+	int pos = jitter_count;
+	uint8_t slot = jitter_free();
+	while(pos > 0 && (int64_t)(jitter_time[jitter_order[pos - 1]] - time) > 0)
+	{
+		jitter_order[pos] = jitter_order[pos - 1];
+		pos--;
+	}
+	jitter_order[pos] = slot;
+	jitter_time[slot] = time;
+	jitter_count++;
+	memcpy(jitter_pages + slot * TOTAL_SIZE, buffer, TOTAL_SIZE);
+}
+
+// a slot that is not in the queue
+uint8_t LedBoard::jitter_free()
+{
+	uint8_t used = 0;
+	for(int i = 0; i < jitter_count; i++)
+		used |= 1 << jitter_order[i];
+	uint8_t slot = 0;
+	while(used & (1 << slot))
+		slot++;
+	return slot;
+}
+
+// presentation time of the next frame in the jitter buffer, 0 when it is empty
+uint64_t LedBoard::nextPresentation()
+{
+	return jitter_count ? jitter_time[jitter_order[0]] : 0;
+}
+
+// show the newest frame that is due, frames before it were too late to be shown
+void LedBoard::present(uint64_t now)
+{
+	int due = 0;
+	while(due < jitter_count && (int64_t)(jitter_time[jitter_order[due]] - now) <= 0)
+		due++;
+	if(!due)
+		return;
+	if(due > 1)
+		statsAdd(stats.jitter_frames_dropped, due - 1);
+
+	uint8_t slot = jitter_order[due - 1];
+	uint64_t delay = now - jitter_time[slot];
+	statsRecord(stats.presentation_delay, delay);
+	if(delay > JITTER_LATE_NS)
+		statsAdd(stats.jitter_frames_late, 1);
+
+	// the front buffer is not drawn into in double buffer mode
+	memcpy(front, jitter_pages + slot * TOTAL_SIZE, TOTAL_SIZE);
+	jitter_count -= due;
+	memmove(jitter_order, jitter_order + due, jitter_count);
+	writeBuffer();
+}
+
+// show the prepared frame for a sync pulse, the pulse reaches all boards at the same time
+void LedBoard::presentPrepared(uint32_t frame, uint64_t sent)
+{
+	if(!sync_prepared || frame != sync_frame)
+	{
+		statsAdd(stats.sync_frames_missed, 1);
+		return;
+	}
+	sync_prepared = false;
+	sync_pending = true;
+	sync_received = statsNow();
+	statsSet(stats.sync_frame, frame);
+	statsSet(stats.sync_sent, sent * 1000);
+	statsSet(stats.sync_received, sync_received);
+	memcpy(front, sync_page, TOTAL_SIZE);
+	writeBuffer();
+}
+
+// draw the curent front buffer on the screen
+// if a frame is still being transmitted the front buffer is sent as soon as it is done,
+// multiple writes in the mean time result in a single frame
 void LedBoard::writeBuffer()
 {
+	if(outputBusy())
+	{
+		if(tx_queued)
+			statsAdd(stats.frames_skipped, 1);
+		tx_queued = true;
+		return;
+	}
+	uint64_t start = statsNow();
+	encodeFrame(front);
+	outputFlush();
+	statsRecord(stats.write_buffer_time, statsNow() - start);
+}
+
+// encode a page that is not one of the board's buffers (shared memory) into the idle
+// transmit buffer, and copy it to the external page in the same pass. nothing is written
+// until outputFlush so the caller can still check that the page did not change while it
+// was read, and call commitExternal if it did not or cancelOutput if it did
+bool LedBoard::prepareExternal(const uint8_t* page)
+{
+	if(outputBusy())
+		return false;
+	encodeFrame(page, external);
+	return true;
+}
+
+// the copy of the external frame becomes the front buffer, so writeBuffer, keepalives and
+// resends show it and in single buffer mode drawing commands draw on top of it
+void LedBoard::commitExternal()
+{
+	uint8_t* committed = external;
+	external = front;
+	if(buffer == front)
+		buffer = committed;
+	front = committed;
+}
+
+// forget the frame in the transmit buffer, only valid before any of it was written
+void LedBoard::cancelOutput()
+{
+	tx_len = tx_pos = 0;
+}
+
+// fill the transmit buffer with a page in panel order, and copy the page to copy if set
+void LedBoard::encodeFrame(const uint8_t* page, uint8_t* copy)
+{
+	tx_start = statsNow();
+	tx_len = tx_pos = 0;
+	tx_generation++;
+	// the synced frame starts now, unless it had to wait for the previous frame
+	if(sync_pending && page == front)
+	{
+		sync_pending = false;
+		statsSet(stats.sync_started, tx_start);
+		statsRecord(stats.sync_latency, tx_start - sync_received);
+		statsAdd(stats.sync_frames, 1);
+	}
 	outputStart();
-	for(int i = 0; i < TOTAL_SIZE; i++)
+	outputSync();
+	if(copy)
+	{
+		// every pixel is read once, what is sent is what is kept
+		for(int i = 0; i < TOTAL_SIZE; i++)
+		{
+			uint16_t pos = pixel_map[i];
+			copy[pos] = page[pos];
+			outputWrite(copy[pos] >> 1);
+		}
+	}
+	else
+	{
+		for(int i = 0; i < TOTAL_SIZE; i++)
+		{
+			outputWrite(page[pixel_map[i]] >> 1);
+		}
+	}
+	outputLatch();
+}
+
+// write as much of the transmit buffer as the serial port accepts
+// returns true when everything, including a queued frame, has been written
+bool LedBoard::outputFlush()
+{
+	while(tx_pos < tx_len)
+	{
+		ssize_t written = fd < 0 ? tx_len - tx_pos : write(fd, tx_buffer + tx_pos, tx_len - tx_pos);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return false;
+			// drop the rest of the frame
+			printf("TX ERROR\n");
+			statsAdd(stats.frames_dropped, 1);
+			tx_pos = tx_len = 0;
+			break;
+		}
+		tx_pos += written;
+		statsAdd(stats.serial_bytes, written);
+		if(tx_pos == tx_len)
+		{
+			uint64_t now = statsNow();
+			statsAdd(stats.frames_transmitted, 1);
+			statsRecord(stats.frame_time, now - tx_start);
+			tx_history[tx_history_pos++ % TX_HISTORY] = now;
+		}
+	}
+
+	// segment commands go between frames, so they are not taken for pixels
+	while(tx_commands_pos < tx_commands_len)
+	{
+		ssize_t written = fd < 0 ? tx_commands_len - tx_commands_pos : write(fd, tx_commands + tx_commands_pos, tx_commands_len - tx_commands_pos);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return false;
+			printf("TX ERROR\n");
+			break;
+		}
+		tx_commands_pos += written;
+		statsAdd(stats.serial_bytes, written);
+	}
+	tx_commands_len = tx_commands_pos = 0;
+
+	if(tx_queued)
+	{
+		tx_queued = false;
+		encodeFrame(front);
+		return outputFlush();
+	}
+	return true;
+}
+
+// set the brightness of all segments, 0-255
+void LedBoard::setBrightness(uint8_t level)
+{
+	uint8_t command[2] = { 0xa0, (uint8_t)(level >> 1) };
+	outputCommand(command, sizeof command);
+}
+
+// let all segments fade to a brightness, they step every SEGMENT_FADE_STEP refreshes
+void LedBoard::fadeBrightness(uint8_t level, uint16_t duration_ms)
+{
+	uint32_t steps = ((uint32_t)duration_ms * SEGMENT_REFRESH_HZ / 1000 + SEGMENT_FADE_STEP / 2) / SEGMENT_FADE_STEP;
+	if(steps > SEGMENT_FADE_STEPS_MAX)
+		steps = SEGMENT_FADE_STEPS_MAX;
+	uint8_t command[3] = { 0xa1, (uint8_t)(level >> 1), (uint8_t)steps };
+	outputCommand(command, sizeof command);
+}
+
+// fill in the 0x54 status reply
+void LedBoard::encodeStatus(uint8_t* out)
+{
+	uint8_t depth = (tx_pos < tx_len) + tx_queued;
+
+	// bytes still to go: the rest of this frame, a queued frame, and what the kernel holds
+	uint32_t pending = tx_len - tx_pos + (tx_queued ? TX_BUFFER_SIZE : 0);
+	int kernel = 0;
+	if(isatty(fd) && ioctl(fd, TIOCOUTQ, &kernel) == 0 && kernel > 0)
+		pending += kernel;
+	// 8N1, 10 bits per byte
+	uint64_t idle_us = (uint64_t)pending * 10 * 1000000 / BAUDRATE;
+	if(idle_us > 0xffffffff)
+		idle_us = 0xffffffff;
+
+	// frames completed in the last window, timed from the first to the last of them
+	uint64_t now = statsNow();
+	uint64_t first = 0;
+	uint64_t last = 0;
+	int count = 0;
+	for(int i = 0; i < TX_HISTORY; i++)
 	{
-		outputWrite(buffer[pixel_map[i]] >> 1);
+		uint64_t time = tx_history[i];
+		if(!time || now - time > TX_FPS_WINDOW_NS)
+			continue;
+		if(!count || time < first) first = time;
+		if(!count || time > last) last = time;
+		count++;
 	}
+	uint32_t fps = count > 1 ? (uint64_t)(count - 1) * 100 * NS_PER_SEC / (last - first) : 0;
+	if(fps > 0xffff)
+		fps = 0xffff;
+
+	out[0] = 0x54;
+	out[1] = tx_generation >> 24;
+	out[2] = tx_generation >> 16;
+	out[3] = tx_generation >> 8;
+	out[4] = tx_generation;
+	out[5] = depth;
+	out[6] = 2 - depth;
+	out[7] = JITTER_SLOTS - jitter_count;
+	out[8] = idle_us >> 24;
+	out[9] = idle_us >> 16;
+	out[10] = idle_us >> 8;
+	out[11] = idle_us;
+	out[12] = fps >> 8;
+	out[13] = fps;
+}
+
+// make writes to the serial port block, for outputs that can not be polled
+void LedBoard::setOutputBlocking()
+{
+	int flags = fcntl(fd, F_GETFL);
+	fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
 }
 
 
@@ -335,20 +1451,70 @@ void LedBoard::setPixel(uint8_t val, uint8_t x, uint8_t y)
 }
 
 
+// set pixel by signed x/y position, ignores pixels outside the board
+void LedBoard::setPixelClipped(uint8_t val, int x, int y)
+{
+	if(x < 0 || y < 0 || x >= width || y >= height) return;
+	buffer[y * width + x] = val;
+}
+
+
 // send a reset / start byte to the segments
 void LedBoard::outputStart()
 {
 	outputWrite(0x80);
 }
 
-// actually write the pixel to the serial interface
-void LedBoard::outputWrite(uint8_t val)
+// send a phase sync, all segments restart their refresh at the same moment so
+// neighbouring panels do not flicker out of step. the low bits count the segments
+// it passed, every segment increments them
+void LedBoard::outputSync()
+{
+	outputWrite(0xb0);
+}
+
+// send a latch byte, all segments show the frame they received at the same time
+void LedBoard::outputLatch()
 {
-	int val2 = fputc(val, fd);
-	if(val2 == EOF)
+	outputWrite(0x90);
+}
+
+// queue a command for the segments, it is written right away when no frame is being
+// written, else after the frame
+void LedBoard::outputCommand(const uint8_t* data, uint8_t len)
+{
+	if(tx_commands_len + len > TX_COMMANDS_SIZE)
 	{
-		printf("TX ERROR\n");
+		printf("Segment command dropped\n");
+		return;
 	}
-	fflush(fd);
+	bool idle = !outputBusy();
+	memcpy(tx_commands + tx_commands_len, data, len);
+	tx_commands_len += len;
+	if(idle)
+		outputFlush();
+}
+
+// add a byte to the transmit buffer
+void LedBoard::outputWrite(uint8_t val)
+{
+	tx_buffer[tx_len++] = val;
 //	Serial1.write(val);
 }
+
+uint64_t LedBoard::readUint64(const uint8_t* data)
+{
+	uint64_t value = 0;
+	for(int i = 0; i < 8; i++)
+		value = (value << 8) | data[i];
+	return value;
+}
+
+void LedBoard::writeUint64(uint8_t* data, uint64_t value)
+{
+	for(int i = 7; i >= 0; i--)
+	{
+		data[i] = value;
+		value >>= 8;
+	}
+}
@@ -4,40 +4,164 @@
 #include <stdint.h>
 #include <stdio.h>
 
+// resampling filters for drawScaledImage
+#define SCALE_NEAREST 0
+#define SCALE_BOX 1
+#define SCALE_BILINEAR 2
+
+// buffer modes for setBufferMode
+#define BUFFER_SINGLE 0
+#define BUFFER_DOUBLE 1
+#define BUFFER_DOUBLE_COPY 2
+
+// frames waiting for their presentation time
+#define JITTER_SLOTS 8
+// completed frames remembered for the frame rate in status replies
+#define TX_HISTORY 64
+// segment command bytes waiting for the end of a frame
+#define TX_COMMANDS_SIZE 64
+
+// sends a reply to the sender of the packet that is being processed
+typedef void (*ReplyCallback)(const uint8_t* data, uint16_t len);
+// called by inputs that write to the board outside of processPacket
+typedef void (*FrameCallback)();
+
 class LedBoard
 {
 public:
-	LedBoard() {};
+	LedBoard() : buffer(pages), front(pages), external(0), buffer_mode(BUFFER_SINGLE), reply(0) {};
 	~LedBoard() {};
 
-	void init();
+	void init(const char* device);
 	void clear();
 
 	bool processPacket(const uint8_t*, uint16_t);
+	void setReplyCallback(ReplyCallback callback) { reply = callback; }
 
 	// draw functions
 	uint16_t drawStringNoLen(char*, uint8_t, uint8_t, uint8_t brightness=0xFF, bool absolute=false);
 	uint16_t drawString(char*, uint16_t, uint8_t, uint8_t, uint8_t brightness=0xFF, bool absolute=false);
 	uint16_t drawImage(uint8_t x, uint8_t y, uint16_t width, uint16_t height, uint8_t* data);
+	uint16_t drawScaledImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t src_width, uint8_t src_height, uint8_t mode, const uint8_t* data);
 	void drawXBM(const uint8_t*, uint16_t);
+	// copy pixels to consecutive positions of the buffer, row by row, clipped at the end
+	void drawSpan(uint16_t pos, const uint8_t* data, uint16_t len);
+
+	// vector primitives, all clipped to the board
+	void fillRect(int x, int y, int width, int height, uint8_t val);
+	void fillGradient(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t from, uint8_t to, bool vertical);
+	void drawLine(int x0, int y0, int x1, int y1, uint8_t val);
+	void drawRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t val);
+	void drawCircle(int x, int y, int radius, uint8_t val, bool filled);
 
-	// output the buffer
+	// buffering
+	bool setBufferMode(uint8_t mode);
+	void flip();
+
+	// scheduled presentation, times are on the statsNow clock
+	uint64_t nextPresentation();
+	void present(uint64_t now);
+
+	// output the front buffer
 	void writeBuffer();
+	// output a page owned by someone else and make it the front buffer, see LedBoard.cpp
+	bool prepareExternal(const uint8_t* page);
+	void commitExternal();
+	void cancelOutput();
+
+	// brightness of the whole board, applied by the segments without sending a frame
+	void setBrightness(uint8_t level);
+	void fadeBrightness(uint8_t level, uint16_t duration_ms);
+
+	// serial output, for the event loop
+	int outputFd() { return fd; }
+	bool outputBusy() { return tx_pos < tx_len || tx_queued || tx_commands_len; }
+	// a frame is waiting behind the one being transmitted
+	bool outputQueued() { return tx_queued; }
+	bool outputFlush();
+	void setOutputBlocking();
 
 private:
 	static int panel_layout[][2];
 	static int width;
 	static int height;
-	static uint8_t buffer[];
+	static uint8_t pages[];
+	// buffer drawn into, and the committed buffer that is written to the screen
+	// both point to the same page in single buffer mode
+	uint8_t* buffer;
+	uint8_t* front;
+	// the third page, a frame from shared memory is copied here and then becomes front
+	uint8_t* external;
+	uint8_t buffer_mode;
 	static uint16_t pixel_map[];
 
-	FILE* fd;
+	int fd;
+	static uint8_t tx_buffer[];
+	uint16_t tx_len;
+	uint16_t tx_pos;
+	// the front buffer has to be sent again once the current frame is done
+	bool tx_queued;
+	// when the frame in the transmit buffer was encoded
+	uint64_t tx_start;
+	// frames encoded so far, and when recent frames were completed
+	uint32_t tx_generation;
+	uint64_t tx_history[TX_HISTORY];
+	uint32_t tx_history_pos;
+	// segment commands, written after the frame that is being transmitted
+	uint8_t tx_commands[TX_COMMANDS_SIZE];
+	uint8_t tx_commands_len;
+	uint8_t tx_commands_pos;
 
+	// reassembly of fragmented blocks
+	static uint8_t fragment_buffer[];
+	static uint8_t fragment_received[];
+	bool fragment_active;
+	// the last block was applied or discarded, fragment_id is the last block seen
+	bool fragment_done;
+	// processing a reassembled block, fragments are not allowed inside it
+	bool fragment_applying;
+	uint16_t fragment_id;
+	uint16_t fragment_length;
+	uint16_t fragment_missing;
+	uint64_t fragment_start;
+
+	ReplyCallback reply;
+
+	// jitter buffer, jitter_order holds the slots sorted by presentation time
+	static uint8_t jitter_pages[];
+	uint64_t jitter_time[JITTER_SLOTS];
+	uint8_t jitter_order[JITTER_SLOTS];
+	uint8_t jitter_count;
+
+	void schedule(uint64_t time);
+
+	// frame prepared for a sync pulse, sync_pending until its transmission starts
+	static uint8_t sync_page[];
+	uint32_t sync_frame;
+	bool sync_prepared;
+	bool sync_pending;
+	uint64_t sync_received;
+
+	void presentPrepared(uint32_t frame, uint64_t sent);
+	uint8_t jitter_free();
+	static uint64_t readUint64(const uint8_t* data);
+	static void writeUint64(uint8_t* data, uint64_t value);
+
+	bool processFragment(uint16_t frame_id, uint16_t offset, uint16_t total_length, const uint8_t* data, uint16_t length);
+
+	void encodeFrame(const uint8_t* page, uint8_t* copy = 0);
+	void encodeStatus(uint8_t* out);
 	void outputStart();
+	void outputSync();
+	void outputLatch();
+	void outputCommand(const uint8_t* data, uint8_t len);
 	void outputWrite(uint8_t);
 	
+	void scaleSpan(int i, uint32_t step, uint8_t src_size, uint8_t mode, uint8_t* start, uint8_t* end, uint8_t* frac);
+
 	void setPixel(uint8_t val, int pos);
 	void setPixel(uint8_t val, uint8_t x, uint8_t y);
+	void setPixelClipped(uint8_t val, int x, int y);
 };
 
 #endif //_IMAGE_GEN_H
\ No newline at end of file
@@ -0,0 +1,566 @@
+#include "LmcpClient.h"
+#include "defines.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+// rows of a 0x10 command
+#define BAND_HEIGHT 8
+#define BAND_COUNT (LMCP_HEIGHT / BAND_HEIGHT)
+// bytes of a 0x10 command
+#define ROWS_SIZE (2 + LMCP_WIDTH * BAND_HEIGHT)
+
+static void writeUint16(uint8_t* out, uint16_t value)
+{
+	out[0] = value >> 8;
+	out[1] = value;
+}
+
+static void writeUint32(uint8_t* out, uint32_t value)
+{
+	for(int i = 0; i < 4; i++)
+		out[i] = value >> (24 - 8 * i);
+}
+
+static void writeUint64(uint8_t* out, uint64_t value)
+{
+	for(int i = 0; i < 8; i++)
+		out[i] = value >> (56 - 8 * i);
+}
+
+// rows from the first to the last bit that is set
+static int rowSpan(uint8_t rows)
+{
+	return 32 - __builtin_clz(rows) - __builtin_ctz(rows);
+}
+
+static uint32_t readUint32(const uint8_t* in)
+{
+	return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+bool LmcpClient::open(const char* host)
+{
+	count = 0;
+	start = 0;
+	used = 0;
+	datagrams_sent = bytes_sent = 0;
+	shadow_valid = false;
+	// a new sender should not start at a fragment id the controller just saw
+	fragment_id = time(0);
+
+	char name[256];
+	snprintf(name, sizeof name, "%s", host);
+	uint16_t port = LMCP_PORT;
+	char* colon = strchr(name, ':');
+	if(colon)
+	{
+		*colon = 0;
+		port = atoi(colon + 1);
+	}
+
+	struct hostent* entry = gethostbyname(name);
+	if(!entry || entry->h_addrtype != AF_INET)
+	{
+		printf("Unknown host %s!\n", name);
+		return false;
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	memcpy(&addr.sin_addr, entry->h_addr_list[0], 4);
+
+	sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if(sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof addr) < 0)
+	{
+		printf("Error connecting to %s!\n", host);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void LmcpClient::close()
+{
+	if(sock >= 0)
+		::close(sock);
+	sock = -1;
+}
+
+bool LmcpClient::setMtu(uint16_t mtu)
+{
+	if(mtu < LMCP_MTU_MIN || mtu > LMCP_QUEUE_BYTES / 2)
+		return false;
+	nextDatagram();
+	this->mtu = mtu;
+	return true;
+}
+
+// close the datagram being filled, the queue is sent when it can not take another full datagram
+void LmcpClient::nextDatagram()
+{
+	if(!used)
+		return;
+	lengths[count++] = used;
+	start += used;
+	used = 0;
+	if(count == LMCP_QUEUE_DATAGRAMS || start + mtu > LMCP_QUEUE_BYTES)
+		flush();
+}
+
+// room for a command of len bytes, len is at most mtu
+uint8_t* LmcpClient::append(uint16_t len)
+{
+	if(used + len > mtu)
+		nextDatagram();
+	uint8_t* out = queue + start + used;
+	used += len;
+	return out;
+}
+
+// queue the command in block, as fragments if it does not fit in a datagram
+void LmcpClient::appendBlock(uint16_t len)
+{
+	if(len <= mtu)
+	{
+		memcpy(append(len), block, len);
+		return;
+	}
+
+	fragment_id++;
+	uint16_t offset = 0;
+	while(offset < len)
+	{
+		// fill the datagram being filled when a useful part still fits
+		if(mtu - used < LMCP_FRAGMENT_HEADER + 64)
+			nextDatagram();
+		uint16_t part = mtu - used - LMCP_FRAGMENT_HEADER;
+		if(part > len - offset)
+			part = len - offset;
+		uint8_t* out = append(LMCP_FRAGMENT_HEADER + part);
+		out[0] = 0x40;
+		writeUint16(out + 1, fragment_id);
+		writeUint16(out + 3, offset);
+		writeUint16(out + 5, len);
+		writeUint16(out + 7, part);
+		memcpy(out + LMCP_FRAGMENT_HEADER, block + offset, part);
+		offset += part;
+	}
+}
+
+bool LmcpClient::flush()
+{
+	if(used)
+	{
+		lengths[count++] = used;
+		start += used;
+		used = 0;
+	}
+
+	struct mmsghdr msgs[LMCP_QUEUE_DATAGRAMS];
+	struct iovec iovecs[LMCP_QUEUE_DATAGRAMS];
+	size_t offset = 0;
+	for(int i = 0; i < count; i++)
+	{
+		iovecs[i].iov_base = queue + offset;
+		iovecs[i].iov_len = lengths[i];
+		offset += lengths[i];
+		memset(&msgs[i], 0, sizeof msgs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	bool success = true;
+	int sent = 0;
+	while(sent < count)
+	{
+		int done = sendmmsg(sock, msgs + sent, count - sent, 0);
+		if(done < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			// the rest is dropped, like a lost datagram
+			success = false;
+			break;
+		}
+		for(int i = sent; i < sent + done; i++)
+			bytes_sent += lengths[i];
+		datagrams_sent += done;
+		sent += done;
+	}
+	count = 0;
+	start = 0;
+	return success;
+}
+
+void LmcpClient::writeBuffer()
+{
+	append(1)[0] = 0x01;
+}
+
+void LmcpClient::clear()
+{
+	append(1)[0] = 0x02;
+}
+
+void LmcpClient::flip()
+{
+	append(1)[0] = 0x03;
+}
+
+void LmcpClient::bufferMode(uint8_t mode)
+{
+	uint8_t* out = append(2);
+	out[0] = 0x04;
+	out[1] = mode;
+}
+
+void LmcpClient::drawRows(uint8_t y, const uint8_t* data)
+{
+	block[0] = 0x10;
+	block[1] = y;
+	memcpy(block + 2, data, LMCP_WIDTH * BAND_HEIGHT);
+	appendBlock(ROWS_SIZE);
+}
+
+// 0x11 commands for a rectangle of a larger image, as many rows per command as fit in
+// the datagram being filled, and in vertical strips when a single row does not fit
+void LmcpClient::drawBand(uint8_t x, uint8_t y, uint8_t width, uint8_t height, const uint8_t* data, uint16_t stride)
+{
+	uint16_t strip = mtu - 5 < width ? mtu - 5 : width;
+	for(uint16_t strip_x = 0; strip_x < width; strip_x += strip)
+	{
+		uint8_t strip_width = width - strip_x < strip ? width - strip_x : strip;
+		uint16_t row = 0;
+		while(row < height)
+		{
+			if(used + 5 + strip_width > mtu)
+				nextDatagram();
+			uint16_t rows = (mtu - used - 5) / strip_width;
+			if(rows > height - row)
+				rows = height - row;
+			uint8_t* out = append(5 + rows * strip_width);
+			out[0] = 0x11;
+			out[1] = x + strip_x;
+			out[2] = y + row;
+			out[3] = strip_width;
+			out[4] = rows;
+			out += 5;
+			for(uint16_t i = 0; i < rows; i++)
+			{
+				memcpy(out, data + (row + i) * stride + strip_x, strip_width);
+				out += strip_width;
+			}
+			row += rows;
+		}
+	}
+}
+
+void LmcpClient::drawImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, const uint8_t* data)
+{
+	if(width && height)
+		drawBand(x, y, width, height, data, width);
+}
+
+// the source can not be split without changing the resampling, large ones go as fragments
+void LmcpClient::drawScaledImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t src_width, uint8_t src_height, uint8_t mode, const uint8_t* data)
+{
+	uint16_t size = src_width * src_height;
+	if(8 + size > LMCP_BLOCK_MAX)
+		return;
+	uint8_t header[8] = { 0x12, x, y, width, height, src_width, src_height, mode };
+	memcpy(block, header, sizeof header);
+	memcpy(block + 8, data, size);
+	appendBlock(8 + size);
+}
+
+// 0x20 and 0x21 only differ in the unit of x and y
+void LmcpClient::text(uint8_t command, uint8_t x, uint8_t y, uint8_t brightness, const char* text)
+{
+	size_t len = strnlen(text, LMCP_BLOCK_MAX - 5);
+	uint8_t header[4] = { command, x, y, brightness };
+	memcpy(block, header, sizeof header);
+	memcpy(block + 4, text, len);
+	block[4 + len] = 0;
+	appendBlock(5 + len);
+}
+
+void LmcpClient::drawText(uint8_t x, uint8_t y, uint8_t brightness, const char* text)
+{
+	this->text(0x20, x, y, brightness, text);
+}
+
+void LmcpClient::drawTextAbsolute(uint8_t x, uint8_t y, uint8_t brightness, const char* text)
+{
+	this->text(0x21, x, y, brightness, text);
+}
+
+void LmcpClient::fillRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t brightness)
+{
+	uint8_t* out = append(6);
+	out[0] = 0x30;
+	out[1] = x;
+	out[2] = y;
+	out[3] = width;
+	out[4] = height;
+	out[5] = brightness;
+}
+
+void LmcpClient::fillGradient(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t from, uint8_t to, bool vertical)
+{
+	uint8_t* out = append(8);
+	out[0] = 0x31;
+	out[1] = x;
+	out[2] = y;
+	out[3] = width;
+	out[4] = height;
+	out[5] = from;
+	out[6] = to;
+	out[7] = vertical;
+}
+
+void LmcpClient::drawHLine(uint8_t x, uint8_t y, uint8_t length, uint8_t brightness)
+{
+	uint8_t* out = append(5);
+	out[0] = 0x32;
+	out[1] = x;
+	out[2] = y;
+	out[3] = length;
+	out[4] = brightness;
+}
+
+void LmcpClient::drawVLine(uint8_t x, uint8_t y, uint8_t length, uint8_t brightness)
+{
+	uint8_t* out = append(5);
+	out[0] = 0x33;
+	out[1] = x;
+	out[2] = y;
+	out[3] = length;
+	out[4] = brightness;
+}
+
+void LmcpClient::drawLine(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t brightness)
+{
+	uint8_t* out = append(6);
+	out[0] = 0x34;
+	out[1] = x0;
+	out[2] = y0;
+	out[3] = x1;
+	out[4] = y1;
+	out[5] = brightness;
+}
+
+void LmcpClient::drawRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t brightness)
+{
+	uint8_t* out = append(6);
+	out[0] = 0x35;
+	out[1] = x;
+	out[2] = y;
+	out[3] = width;
+	out[4] = height;
+	out[5] = brightness;
+}
+
+void LmcpClient::drawCircle(uint8_t x, uint8_t y, uint8_t radius, uint8_t brightness, bool filled)
+{
+	uint8_t* out = append(6);
+	out[0] = 0x36;
+	out[1] = x;
+	out[2] = y;
+	out[3] = radius;
+	out[4] = brightness;
+	out[5] = filled;
+}
+
+void LmcpClient::requestClock(uint64_t cookie)
+{
+	uint8_t* out = append(9);
+	out[0] = 0x50;
+	writeUint64(out + 1, cookie);
+}
+
+void LmcpClient::presentAt(uint64_t time)
+{
+	uint8_t* out = append(9);
+	out[0] = 0x51;
+	writeUint64(out + 1, time);
+}
+
+void LmcpClient::prepare(uint32_t frame)
+{
+	uint8_t* out = append(5);
+	out[0] = 0x52;
+	writeUint32(out + 1, frame);
+}
+
+void LmcpClient::present(uint32_t frame, uint64_t sent)
+{
+	uint8_t* out = append(13);
+	out[0] = 0x53;
+	writeUint32(out + 1, frame);
+	writeUint64(out + 5, sent);
+}
+
+void LmcpClient::requestStatus()
+{
+	append(1)[0] = 0x54;
+}
+
+void LmcpClient::setBrightness(uint8_t level)
+{
+	uint8_t* out = append(2);
+	out[0] = 0x60;
+	out[1] = level;
+}
+
+void LmcpClient::fadeBrightness(uint8_t level, uint16_t duration_ms)
+{
+	uint8_t* out = append(4);
+	out[0] = 0x61;
+	out[1] = level;
+	out[2] = duration_ms >> 8;
+	out[3] = duration_ms;
+}
+
+// per band of 8 rows: runs of changed columns become 0x11 rectangles over the rows that
+// changed, unless sending the whole band with 0x10 is smaller
+void LmcpClient::sendChanges()
+{
+	for(int band = 0; band < BAND_COUNT; band++)
+	{
+		int band_y = band * BAND_HEIGHT;
+		const uint8_t* band_frame = frame + band_y * LMCP_WIDTH;
+		if(!shadow_valid)
+		{
+			drawRows(band, band_frame);
+			continue;
+		}
+
+		// changed rows per column, 0 for unchanged columns
+		uint8_t column_rows[LMCP_WIDTH];
+		const uint8_t* band_shadow = shadow + band_y * LMCP_WIDTH;
+		for(int x = 0; x < LMCP_WIDTH; x++)
+		{
+			uint8_t rows = 0;
+			for(int y = 0; y < BAND_HEIGHT; y++)
+			{
+				if(band_frame[y * LMCP_WIDTH + x] != band_shadow[y * LMCP_WIDTH + x])
+					rows |= 1 << y;
+			}
+			column_rows[x] = rows;
+		}
+
+		// runs of changed columns, neighbouring runs are joined when the unchanged
+		// columns between them cost less than the header of another command
+		uint8_t run_x[LMCP_WIDTH], run_width[LMCP_WIDTH], run_rows[LMCP_WIDTH];
+		int runs = 0;
+		int cost = 0;
+		for(int x = 0; x < LMCP_WIDTH; x++)
+		{
+			if(!column_rows[x])
+				continue;
+			if(runs)
+			{
+				int gap = x - run_x[runs - 1] - run_width[runs - 1];
+				uint8_t rows = run_rows[runs - 1] | column_rows[x];
+				if(gap * rowSpan(rows) <= 5)
+				{
+					run_width[runs - 1] = x - run_x[runs - 1] + 1;
+					run_rows[runs - 1] = rows;
+					continue;
+				}
+			}
+			run_x[runs] = x;
+			run_width[runs] = 1;
+			run_rows[runs] = column_rows[x];
+			runs++;
+		}
+		for(int i = 0; i < runs; i++)
+		{
+			cost += 5 + run_width[i] * rowSpan(run_rows[i]);
+		}
+
+		if(cost >= ROWS_SIZE)
+		{
+			drawRows(band, band_frame);
+			continue;
+		}
+		for(int i = 0; i < runs; i++)
+		{
+			int top = __builtin_ctz(run_rows[i]);
+			drawBand(run_x[i], band_y + top, run_width[i], rowSpan(run_rows[i]), band_frame + top * LMCP_WIDTH + run_x[i], LMCP_WIDTH);
+		}
+	}
+	memcpy(shadow, frame, sizeof shadow);
+	shadow_valid = true;
+	writeBuffer();
+}
+
+bool LmcpClient::status(LmcpStatus* status, int timeout_ms)
+{
+	if(!flush())
+		return false;
+	uint8_t request = 0x54;
+	if(send(sock, &request, 1, 0) < 0)
+		return false;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t end = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + timeout_ms;
+	int64_t left = timeout_ms;
+	while(left >= 0)
+	{
+		struct pollfd pfd = { sock, POLLIN, 0 };
+		if(poll(&pfd, 1, left) > 0)
+		{
+			uint8_t reply[64];
+			ssize_t len = recv(sock, reply, sizeof reply, MSG_DONTWAIT);
+			// other replies (0x50) are not waited for here
+			if(len >= 14 && reply[0] == 0x54)
+			{
+				status->generation = readUint32(reply + 1);
+				status->queue_depth = reply[5];
+				status->credits = reply[6];
+				status->jitter_free = reply[7];
+				status->idle_us = readUint32(reply + 8);
+				status->fps = (reply[12] << 8) | reply[13];
+				return true;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		left = end - (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+	}
+	return false;
+}
+
+// while there are no credits the serial link is busy for about idle_us
+bool LmcpClient::waitCredit(int timeout_ms)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t end = now.tv_sec * 1000000LL + now.tv_nsec / 1000 + timeout_ms * 1000LL;
+	while(true)
+	{
+		LmcpStatus current;
+		if(!status(&current, timeout_ms))
+			return false;
+		if(current.credits)
+			return true;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t left = end - (now.tv_sec * 1000000LL + now.tv_nsec / 1000);
+		if(left <= 0)
+			return false;
+		// ask again a little before the link is expected to be idle
+		int64_t wait = current.idle_us > 1000 ? current.idle_us - 500 : 500;
+		usleep(wait < left ? wait : left);
+	}
+}
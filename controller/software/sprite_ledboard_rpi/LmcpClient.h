@@ -0,0 +1,136 @@
+#ifndef _LMCP_CLIENT_H_
+#define _LMCP_CLIENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+// encodes LMCP commands for a controller and packs them into as few datagrams as possible
+//
+//	LmcpClient client;
+//	client.open("ledboard");
+//	client.fillRect(0, 0, 96, 48, 0);
+//	client.drawText(0, 0, 0xff, "hello");
+//	client.writeBuffer();
+//	client.flush();
+//
+// commands are queued in datagrams of at most mtu bytes and sent together by flush,
+// a command that does not fit in one datagram is split (images) or sent as 0x40 fragments.
+// all buffers are part of the object, nothing is allocated after open
+
+#define LMCP_WIDTH 96
+#define LMCP_HEIGHT 48
+// 1500 byte ethernet frames without the ip and udp headers
+#define LMCP_MTU_DEFAULT 1472
+// a command never needs less, the largest fixed size command is 9 bytes
+#define LMCP_MTU_MIN 64
+// bytes and datagrams queued before flush is called by itself
+#define LMCP_QUEUE_BYTES 65536
+#define LMCP_QUEUE_DATAGRAMS 64
+// largest block sent in fragments, the controller's staging buffer
+#define LMCP_BLOCK_MAX 8192
+#define LMCP_FRAGMENT_HEADER 9
+
+// reply to 0x54
+struct LmcpStatus
+{
+	uint32_t generation;
+	uint8_t queue_depth;
+	uint8_t credits;
+	uint8_t jitter_free;
+	uint32_t idle_us;
+	uint16_t fps;	// times 100
+};
+
+class LmcpClient
+{
+public:
+	LmcpClient() : datagrams_sent(0), bytes_sent(0), sock(-1), mtu(LMCP_MTU_DEFAULT), count(0), start(0), used(0), fragment_id(0), shadow_valid(false) {};
+
+	// host[:port], port defaults to 1337
+	bool open(const char* host);
+	void close();
+	// largest datagram to send, at least LMCP_MTU_MIN
+	bool setMtu(uint16_t mtu);
+
+	// buffers
+	void writeBuffer();
+	void clear();
+	void flip();
+	void bufferMode(uint8_t mode);
+
+	// pixels, width * height bytes row by row
+	void drawRows(uint8_t y, const uint8_t* data);
+	void drawImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, const uint8_t* data);
+	void drawScaledImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t src_width, uint8_t src_height, uint8_t mode, const uint8_t* data);
+
+	// text, x and y in characters for drawText and in pixels for drawTextAbsolute
+	void drawText(uint8_t x, uint8_t y, uint8_t brightness, const char* text);
+	void drawTextAbsolute(uint8_t x, uint8_t y, uint8_t brightness, const char* text);
+
+	// vector primitives
+	void fillRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t brightness);
+	void fillGradient(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t from, uint8_t to, bool vertical);
+	void drawHLine(uint8_t x, uint8_t y, uint8_t length, uint8_t brightness);
+	void drawVLine(uint8_t x, uint8_t y, uint8_t length, uint8_t brightness);
+	void drawLine(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t brightness);
+	void drawRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t brightness);
+	void drawCircle(uint8_t x, uint8_t y, uint8_t radius, uint8_t brightness, bool filled);
+
+	// timing and sync, times in microseconds
+	void requestClock(uint64_t cookie);
+	void presentAt(uint64_t time);
+	void prepare(uint32_t frame);
+	void present(uint32_t frame, uint64_t sent);
+	void requestStatus();
+
+	// brightness of the whole board, applied by the segments
+	void setBrightness(uint8_t level);
+	void fadeBrightness(uint8_t level, uint16_t duration_ms);
+
+	// send everything that is queued, one sendmmsg call for all datagrams
+	bool flush();
+
+	// shadow framebuffer: draw a whole frame into canvas(), sendChanges queues only the
+	// parts that differ from what was sent before, followed by a write
+	uint8_t* canvas() { return frame; }
+	void sendChanges();
+	// the controller lost its picture (restart), send the whole frame next time
+	void invalidate() { shadow_valid = false; }
+
+	// ask for the status and wait for the reply, false on timeout
+	bool status(LmcpStatus* status, int timeout_ms);
+	// wait until the controller can take a frame without replacing another
+	bool waitCredit(int timeout_ms);
+
+	// counters
+	uint64_t datagrams_sent;
+	uint64_t bytes_sent;
+
+private:
+	int sock;
+	uint16_t mtu;
+
+	// queued datagrams, back to back in queue
+	uint8_t queue[LMCP_QUEUE_BYTES];
+	uint16_t lengths[LMCP_QUEUE_DATAGRAMS];
+	int count;
+	size_t start;		// offset of the datagram being filled
+	uint16_t used;		// bytes in the datagram being filled
+
+	// a command that may be larger than a datagram is built here first
+	uint8_t block[LMCP_BLOCK_MAX];
+	uint16_t fragment_id;
+
+	uint8_t frame[LMCP_WIDTH * LMCP_HEIGHT];
+	uint8_t shadow[LMCP_WIDTH * LMCP_HEIGHT];
+	bool shadow_valid;
+
+	uint8_t* append(uint16_t len);
+	void nextDatagram();
+	void appendBlock(uint16_t len);
+	void text(uint8_t command, uint8_t x, uint8_t y, uint8_t brightness, const char* text);
+	void drawBand(uint8_t x, uint8_t y, uint8_t width, uint8_t height, const uint8_t* data, uint16_t stride);
+};
+
+#endif //_LMCP_CLIENT_H_
@@ -0,0 +1,139 @@
+#include "ShmInput.h"
+#include "Stats.h"
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+// create the ring in /dev/shm and the socket that hands out the eventfd
+bool ShmInput::open(const char* name, EventLoop* loop, LedBoard* board, FrameCallback callback)
+{
+	this->callback = callback;
+	this->loop = loop;
+	this->board = board;
+
+	char path[108];
+	snprintf(path, sizeof path, "/%s", name);
+	// owner and group only, anyone who can write the ring can put frames on the board.
+	// an object left by an older run may have other permissions, fchmod sets them again
+	int fd = shm_open(path, O_CREAT | O_RDWR, 0660);
+	if(fd < 0 || fchmod(fd, 0660) < 0 || ftruncate(fd, sizeof(FrameRing)) < 0)
+	{
+		printf("Error creating shared memory %s!\n", path);
+		return false;
+	}
+	ring = (FrameRing*)mmap(0, sizeof(FrameRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ring == MAP_FAILED)
+	{
+		ring = 0;
+		return false;
+	}
+
+	// start over, a producer of a previous run reconnects to the new eventfd
+	memset(ring, 0, sizeof(FrameRing));
+	ring->version = FRAME_RING_VERSION;
+	ring->slot_count = FRAME_RING_SLOTS;
+	ring->width = FRAME_RING_WIDTH;
+	ring->height = FRAME_RING_HEIGHT;
+	__atomic_store_n(&ring->magic, FRAME_RING_MAGIC, __ATOMIC_RELEASE);
+	consumed = 0;
+
+	event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(event_fd < 0)
+		return false;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	// abstract socket, the name starts with a 0 byte and needs no cleanup
+	int len = snprintf(addr.sun_path + 1, sizeof addr.sun_path - 1, "ledboard-%s", name);
+	socklen_t addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + len;
+	if(listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, addr_len) < 0 || listen(listen_fd, 4) < 0)
+	{
+		printf("Error creating shared memory socket!\n");
+		return false;
+	}
+
+	return loop->addFd(listen_fd, EPOLLIN, &acceptEvent, this) &&
+		loop->addFd(event_fd, EPOLLIN, &notifyEvent, this);
+}
+
+// send the eventfd to a producer and hang up
+void ShmInput::acceptEvent(int fd, uint32_t events, void* ctx)
+{
+	ShmInput* input = (ShmInput*)ctx;
+	int client = accept4(fd, 0, 0, SOCK_CLOEXEC);
+	if(client < 0)
+		return;
+
+	char byte = 0;
+	struct iovec iov = { &byte, 1 };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof control;
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &input->event_fd, sizeof(int));
+	sendmsg(client, &msg, MSG_NOSIGNAL);
+	close(client);
+}
+
+void ShmInput::notifyEvent(int fd, uint32_t events, void* ctx)
+{
+	uint64_t count;
+	if(read(fd, &count, sizeof count) != sizeof count)
+		return;
+	// the callback polls once the output state is known
+	((ShmInput*)ctx)->callback();
+}
+
+void ShmInput::poll()
+{
+	if(!ring)
+		return;
+	uint64_t published = __atomic_load_n(&ring->published, __ATOMIC_ACQUIRE);
+	if(published == consumed || board->outputBusy())
+		return;
+
+	// only the newest frame is shown, older ones were superseded
+	if(published - consumed > 1)
+		statsAdd(stats.shm_frames_skipped, published - consumed - 1);
+
+	FrameSlot* slot = &ring->slots[(published - 1) % FRAME_RING_SLOTS];
+	uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+	if(sequence & 1)
+	{
+		// the producer lapped the ring and is writing this slot, a newer frame follows
+		return;
+	}
+
+	board->prepareExternal(slot->pixels);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if(__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence)
+	{
+		// overwritten while it was encoded, wait for the newer frame
+		board->cancelOutput();
+		statsAdd(stats.shm_frames_torn, 1);
+		return;
+	}
+
+	board->commitExternal();
+	consumed = published;
+	statsAdd(stats.shm_frames, 1);
+	board->outputFlush();
+}
@@ -0,0 +1,33 @@
+#ifndef _SHM_INPUT_H_
+#define _SHM_INPUT_H_
+
+#include <stdint.h>
+#include "EventLoop.h"
+#include "LedBoard.h"
+#include "FrameRing.h"
+
+// consumes frames from local producers through a shared memory ring
+class ShmInput
+{
+public:
+	ShmInput() : loop(0), board(0), callback(0), ring(0), consumed(0), event_fd(-1), listen_fd(-1) {};
+
+	bool open(const char* name, EventLoop* loop, LedBoard* board, FrameCallback callback);
+
+	// transmit the newest published frame if there is one and the output is idle
+	void poll();
+
+private:
+	EventLoop* loop;
+	LedBoard* board;
+	FrameCallback callback;
+	FrameRing* ring;
+	uint64_t consumed;
+	int event_fd;
+	int listen_fd;
+
+	static void acceptEvent(int fd, uint32_t events, void* ctx);
+	static void notifyEvent(int fd, uint32_t events, void* ctx);
+};
+
+#endif //_SHM_INPUT_H_
@@ -0,0 +1,94 @@
+#include "ShmProducer.h"
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+bool ShmProducer::open(const char* name)
+{
+	char path[108];
+	snprintf(path, sizeof path, "/%s", name);
+	int fd = shm_open(path, O_RDWR, 0);
+	if(fd < 0)
+		return false;
+	void* map = mmap(0, sizeof(FrameRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(map == MAP_FAILED)
+		return false;
+	ring = (FrameRing*)map;
+	if(__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != FRAME_RING_MAGIC || ring->version != FRAME_RING_VERSION)
+	{
+		close();
+		return false;
+	}
+
+	// fetch the controller's eventfd
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	int len = snprintf(addr.sun_path + 1, sizeof addr.sun_path - 1, "ledboard-%s", name);
+	socklen_t addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + len;
+	if(sock < 0 || connect(sock, (struct sockaddr*)&addr, addr_len) < 0)
+	{
+		if(sock >= 0) ::close(sock);
+		close();
+		return false;
+	}
+
+	char byte;
+	struct iovec iov = { &byte, 1 };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof control;
+	ssize_t received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	::close(sock);
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	if(received != 1 || !cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+	{
+		close();
+		return false;
+	}
+	memcpy(&event_fd, CMSG_DATA(cmsg), sizeof(int));
+	return true;
+}
+
+void ShmProducer::close()
+{
+	if(ring)
+		munmap(ring, sizeof(FrameRing));
+	if(event_fd >= 0)
+		::close(event_fd);
+	ring = 0;
+	event_fd = -1;
+	slot = 0;
+}
+
+uint8_t* ShmProducer::beginFrame()
+{
+	slot = &ring->slots[ring->published % FRAME_RING_SLOTS];
+	// odd: being written
+	__atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return slot->pixels;
+}
+
+void ShmProducer::publish()
+{
+	slot->frame = ring->published;
+	__atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->published, ring->published + 1, __ATOMIC_RELEASE);
+	uint64_t one = 1;
+	if(write(event_fd, &one, sizeof one) < 0)
+	{
+		// the counter is saturated, the controller is already awake
+	}
+}
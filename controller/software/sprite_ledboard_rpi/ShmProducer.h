@@ -0,0 +1,35 @@
+#ifndef _SHM_PRODUCER_H_
+#define _SHM_PRODUCER_H_
+
+#include <stdint.h>
+#include "FrameRing.h"
+
+// writes frames into the shared memory ring of a controller started with -M name
+//
+//	ShmProducer producer;
+//	producer.open("ledboard");
+//	uint8_t* pixels = producer.beginFrame();
+//	... draw 96x48 pixels, row by row ...
+//	producer.publish();
+class ShmProducer
+{
+public:
+	ShmProducer() : ring(0), event_fd(-1), slot(0) {};
+
+	bool open(const char* name);
+	void close();
+
+	// pixels of the next slot, valid until publish
+	uint8_t* beginFrame();
+	// make the frame visible to the controller and wake it up
+	void publish();
+
+	uint64_t published() { return ring ? ring->published : 0; }
+
+private:
+	FrameRing* ring;
+	int event_fd;
+	FrameSlot* slot;
+};
+
+#endif //_SHM_PRODUCER_H_
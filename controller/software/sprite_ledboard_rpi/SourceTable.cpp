@@ -0,0 +1,184 @@
+#include "SourceTable.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#define NS_PER_TOKEN 1000000000ULL
+
+void SourceTable::setRateLimit(uint32_t rate, uint32_t burst)
+{
+	this->rate = rate;
+	this->burst = burst ? burst : 1;
+}
+
+void SourceTable::setHold(uint32_t seconds)
+{
+	hold_ns = seconds * 1000000000ULL;
+}
+
+bool SourceTable::addRule(const char* rule)
+{
+	if(rule_count >= SOURCE_RULES_MAX)
+		return false;
+
+	char addr[32];
+	const char* equals = strchr(rule, '=');
+	if(!equals || equals - rule >= (int)sizeof addr)
+		return false;
+	memcpy(addr, rule, equals - rule);
+	addr[equals - rule] = 0;
+
+	uint16_t port = 0;
+	char* colon = strchr(addr, ':');
+	if(colon)
+	{
+		*colon = 0;
+		port = htons(atoi(colon + 1));
+	}
+
+	struct in_addr in;
+	if(inet_pton(AF_INET, addr, &in) != 1)
+		return false;
+
+	int priority = atoi(equals + 1);
+	if(priority < 0 || priority > 255)
+		return false;
+
+	rules[rule_count].addr = in.s_addr;
+	rules[rule_count].port = port;
+	rules[rule_count].priority = priority;
+	rule_count++;
+	return true;
+}
+
+uint8_t SourceTable::priorityFor(uint32_t addr, uint16_t port)
+{
+	for(int i = 0; i < rule_count; i++)
+	{
+		if(rules[i].addr == addr && (rules[i].port == 0 || rules[i].port == port))
+			return rules[i].priority;
+	}
+	return 0;
+}
+
+// find the entry for src, or take a free one, or replace the one that sent least recently
+Source* SourceTable::lookup(const struct sockaddr_in* src, uint64_t now)
+{
+	Source* free_entry = 0;
+	Source* oldest = 0;
+	for(int i = 0; i < SOURCE_TABLE_SIZE; i++)
+	{
+		Source* source = &sources[i];
+		if(!source->used)
+		{
+			if(!free_entry) free_entry = source;
+			continue;
+		}
+		if(source->addr == src->sin_addr.s_addr && source->port == src->sin_port)
+			return source;
+		// never replace the owner
+		if(source != owner && (!oldest || source->last_refill < oldest->last_refill))
+			oldest = source;
+	}
+
+	Source* source = free_entry ? free_entry : oldest;
+	memset(source, 0, sizeof *source);
+	source->used = true;
+	source->addr = src->sin_addr.s_addr;
+	source->port = src->sin_port;
+	source->priority = priorityFor(source->addr, source->port);
+	source->tokens = (uint64_t)burst * NS_PER_TOKEN;
+	source->last_refill = now;
+	return source;
+}
+
+bool SourceTable::admit(const struct sockaddr_in* src, uint16_t len, uint64_t now)
+{
+	Source* source = lookup(src, now);
+
+	// the bucket fills for every packet, also the ones that are dropped
+	if(rate)
+	{
+		uint64_t max = (uint64_t)burst * NS_PER_TOKEN;
+		uint64_t elapsed = now - source->last_refill;
+		// the bucket is full after max / rate (rounded up), this also keeps the multiplication
+		// from overflowing
+		if(elapsed > max / rate + 1) elapsed = max / rate + 1;
+		source->tokens += elapsed * rate;
+		if(source->tokens > max) source->tokens = max;
+	}
+	source->last_refill = now;
+
+	// ownership ends hold_ns after the owner's last accepted packet
+	if(owner && now - owner->last_seen > hold_ns && owner != source)
+		owner = 0;
+
+	if(owner && source != owner && source->priority < owner->priority)
+	{
+		source->dropped_priority++;
+		return false;
+	}
+
+	if(rate)
+	{
+		if(source->tokens < NS_PER_TOKEN)
+		{
+			source->dropped_rate++;
+			return false;
+		}
+		source->tokens -= NS_PER_TOKEN;
+	}
+	source->last_seen = now;
+
+	// a priority source takes over from anyone with the same or a lower priority
+	if(source->priority > 0 && (!owner || source->priority >= owner->priority))
+		owner = source;
+
+	source->packets++;
+	source->bytes += len;
+	return true;
+}
+
+size_t SourceTable::format(char* out, size_t size)
+{
+	static const char* names[] = {
+		"ledboard_source_packets_total",
+		"ledboard_source_bytes_total",
+		"ledboard_source_dropped_rate_total",
+		"ledboard_source_dropped_priority_total",
+	};
+	static const char* help[] = {
+		"Datagrams accepted by sender.",
+		"Bytes accepted by sender.",
+		"Datagrams dropped by the rate limit by sender.",
+		"Datagrams dropped because a higher priority sender owned the board.",
+	};
+
+	size_t total = 0;
+	for(int metric = 0; metric < 4; metric++)
+	{
+		int len = snprintf(out + total, size - total, "# HELP %s %s\n# TYPE %s counter\n", names[metric], help[metric], names[metric]);
+		if(len < 0 || total + len >= size) return total;
+		total += len;
+
+		for(int i = 0; i < SOURCE_TABLE_SIZE; i++)
+		{
+			Source* source = &sources[i];
+			if(!source->used) continue;
+			uint64_t values[] = { source->packets, source->bytes, source->dropped_rate, source->dropped_priority };
+
+			char addr[INET_ADDRSTRLEN];
+			struct in_addr in;
+			in.s_addr = source->addr;
+			inet_ntop(AF_INET, &in, addr, sizeof addr);
+
+			len = snprintf(out + total, size - total, "%s{source=\"%s:%d\",priority=\"%d\",owner=\"%d\"} %llu\n",
+				names[metric], addr, ntohs(source->port), source->priority, source == owner,
+				(unsigned long long)values[metric]);
+			if(len < 0 || total + len >= size) return total;
+			total += len;
+		}
+	}
+	return total;
+}
@@ -0,0 +1,70 @@
+#ifndef _SOURCE_TABLE_H_
+#define _SOURCE_TABLE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+// number of senders tracked at the same time, the least recently seen is replaced
+#define SOURCE_TABLE_SIZE 32
+// number of configurable priority rules
+#define SOURCE_RULES_MAX 16
+// seconds a priority source keeps ownership after its last packet
+#define SOURCE_HOLD_DEFAULT 5
+
+struct Source
+{
+	uint32_t addr;		// network byte order
+	uint16_t port;		// network byte order
+	uint8_t priority;
+	bool used;
+	uint64_t last_seen;	// ns, monotonic, last accepted packet
+	uint64_t last_refill;	// ns, monotonic, last packet, when the bucket was filled
+	uint64_t tokens;	// in 1e-9 packets
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t dropped_rate;
+	uint64_t dropped_priority;
+};
+
+// identifies senders by address and port, applies a per sender token bucket and
+// gives the highest priority sender that is active ownership of the board
+class SourceTable
+{
+public:
+	SourceTable() : rate(0), burst(0), hold_ns(SOURCE_HOLD_DEFAULT * 1000000000ULL), rule_count(0), owner(0) {};
+
+	// rate in packets per second (0: unlimited), burst in packets
+	void setRateLimit(uint32_t rate, uint32_t burst);
+	void setHold(uint32_t seconds);
+	// parse "a.b.c.d[:port]=priority", port 0 matches any port
+	bool addRule(const char* rule);
+
+	// returns whether a datagram from src may be processed
+	bool admit(const struct sockaddr_in* src, uint16_t len, uint64_t now);
+
+	// append the per source counters in the prometheus text exposition format
+	size_t format(char* out, size_t size);
+
+private:
+	struct Rule
+	{
+		uint32_t addr;
+		uint16_t port;
+		uint8_t priority;
+	};
+
+	uint32_t rate;
+	uint32_t burst;
+	uint64_t hold_ns;
+	Rule rules[SOURCE_RULES_MAX];
+	int rule_count;
+	Source sources[SOURCE_TABLE_SIZE];
+	// source that currently owns the board, if any
+	Source* owner;
+
+	Source* lookup(const struct sockaddr_in* src, uint64_t now);
+	uint8_t priorityFor(uint32_t addr, uint16_t port);
+};
+
+#endif //_SOURCE_TABLE_H_
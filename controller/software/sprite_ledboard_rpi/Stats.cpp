@@ -0,0 +1,139 @@
+#include "Stats.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+Stats stats;
+
+// appends to out, keeps track of the remaining size and the bytes written
+static void append(char*& out, size_t& size, size_t& total, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(out, size, format, args);
+	va_end(args);
+	if(len < 0) return;
+	// output that did not fit is cut off
+	if((size_t)len >= size) len = size ? size - 1 : 0;
+	total += len;
+	out += len;
+	size -= len;
+}
+
+static uint64_t load(const uint64_t& counter)
+{
+	return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+static void counter(char*& out, size_t& size, size_t& total, const char* name, const char* help, uint64_t value)
+{
+	append(out, size, total, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+}
+
+static void gauge(char*& out, size_t& size, size_t& total, const char* name, const char* help, double value)
+{
+	append(out, size, total, "# HELP %s %s\n# TYPE %s gauge\n%s %.9f\n", name, help, name, name, value);
+}
+
+// bucket i holds durations below 2^i ns
+static void histogram(char*& out, size_t& size, size_t& total, const char* name, const char* labels, const Histogram& h)
+{
+	uint64_t cumulative = 0;
+	for(int i = 0; i < STATS_BUCKETS - 1; i++)
+	{
+		cumulative += load(h.buckets[i]);
+		append(out, size, total, "%s_bucket{%sle=\"%.9f\"} %llu\n", name, labels, (double)(1ULL << i) / 1e9, (unsigned long long)cumulative);
+	}
+	append(out, size, total, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels, (unsigned long long)load(h.count));
+	// strip the trailing comma for the labels of sum and count
+	int labels_len = 0;
+	while(labels[labels_len]) labels_len++;
+	if(labels_len)
+	{
+		labels_len--;
+		append(out, size, total, "%s_sum{%.*s} %.9f\n", name, labels_len, labels, load(h.sum) / 1e9);
+		append(out, size, total, "%s_count{%.*s} %llu\n", name, labels_len, labels, (unsigned long long)load(h.count));
+	}
+	else
+	{
+		append(out, size, total, "%s_sum %.9f\n", name, load(h.sum) / 1e9);
+		append(out, size, total, "%s_count %llu\n", name, (unsigned long long)load(h.count));
+	}
+}
+
+size_t Stats::format(char* out, size_t size)
+{
+	size_t total = 0;
+
+	counter(out, size, total, "ledboard_packets_received_total", "Datagrams handed to processPacket.", load(packets_received));
+	counter(out, size, total, "ledboard_bytes_received_total", "Bytes handed to processPacket.", load(bytes_received));
+
+	append(out, size, total, "# HELP ledboard_commands_total Commands executed by command byte.\n# TYPE ledboard_commands_total counter\n");
+	for(int i = 0; i < 256; i++)
+	{
+		if(load(commands[i]))
+			append(out, size, total, "ledboard_commands_total{command=\"0x%02x\"} %llu\n", i, (unsigned long long)load(commands[i]));
+	}
+
+	append(out, size, total, "# HELP ledboard_parse_errors_total Packets rejected by command byte.\n# TYPE ledboard_parse_errors_total counter\n");
+	for(int i = 0; i < 256; i++)
+	{
+		if(load(parse_errors[i]))
+			append(out, size, total, "ledboard_parse_errors_total{command=\"0x%02x\"} %llu\n", i, (unsigned long long)load(parse_errors[i]));
+	}
+
+	append(out, size, total, "# HELP ledboard_command_seconds Command execution time, sampled 1 in %d packets.\n# TYPE ledboard_command_seconds histogram\n", STATS_SAMPLE_RATE);
+	for(int i = 0; i < 256; i++)
+	{
+		if(!load(command_time[i].count)) continue;
+		char labels[32];
+		snprintf(labels, sizeof labels, "command=\"0x%02x\",", i);
+		histogram(out, size, total, "ledboard_command_seconds", labels, command_time[i]);
+	}
+
+	counter(out, size, total, "ledboard_frames_transmitted_total", "Frames written to the serial port.", load(frames_transmitted));
+	counter(out, size, total, "ledboard_frames_skipped_total", "Frame writes merged into a frame that was already queued.", load(frames_skipped));
+	counter(out, size, total, "ledboard_frames_dropped_total", "Frames cut short by a serial write error.", load(frames_dropped));
+	counter(out, size, total, "ledboard_serial_bytes_total", "Bytes written to the serial port.", load(serial_bytes));
+
+	append(out, size, total, "# HELP ledboard_write_buffer_seconds Time spent in writeBuffer.\n# TYPE ledboard_write_buffer_seconds histogram\n");
+	histogram(out, size, total, "ledboard_write_buffer_seconds", "", write_buffer_time);
+	append(out, size, total, "# HELP ledboard_frame_seconds Time from encoding a frame to its last byte being written.\n# TYPE ledboard_frame_seconds histogram\n");
+	histogram(out, size, total, "ledboard_frame_seconds", "", frame_time);
+
+	counter(out, size, total, "ledboard_fragments_received_total", "Fragments added to the staging buffer.", load(fragments_received));
+	counter(out, size, total, "ledboard_fragments_stale_total", "Fragments of a block that was already applied or discarded.", load(fragments_stale));
+	counter(out, size, total, "ledboard_fragment_blocks_completed_total", "Fragmented blocks reassembled and processed.", load(fragment_blocks_completed));
+	counter(out, size, total, "ledboard_fragment_blocks_discarded_total", "Fragmented blocks discarded incomplete.", load(fragment_blocks_discarded));
+
+	counter(out, size, total, "ledboard_stream_connections_total", "Accepted tcp and unix stream connections.", load(stream_connections));
+	counter(out, size, total, "ledboard_stream_bytes_total", "Bytes read from stream connections.", load(stream_bytes));
+	counter(out, size, total, "ledboard_stream_blocks_total", "Blocks received on stream connections.", load(stream_blocks));
+	counter(out, size, total, "ledboard_stream_pauses_total", "Times stream reading was paused because the serial output was full.", load(stream_pauses));
+	counter(out, size, total, "ledboard_shm_frames_total", "Frames taken from the shared memory ring.", load(shm_frames));
+	counter(out, size, total, "ledboard_shm_frames_skipped_total", "Shared memory frames replaced by a newer frame before the serial port was free.", load(shm_frames_skipped));
+	counter(out, size, total, "ledboard_shm_frames_torn_total", "Shared memory frames overwritten while they were encoded.", load(shm_frames_torn));
+
+	counter(out, size, total, "ledboard_jitter_frames_scheduled_total", "Frames queued for presentation with 0x51.", load(jitter_frames_scheduled));
+	counter(out, size, total, "ledboard_jitter_frames_late_total", "Scheduled frames shown more than 2 ms after their presentation time.", load(jitter_frames_late));
+	counter(out, size, total, "ledboard_jitter_frames_dropped_total", "Scheduled frames that were replaced by a later one, or did not fit in the jitter buffer.", load(jitter_frames_dropped));
+	append(out, size, total, "# HELP ledboard_presentation_delay_seconds Time between the presentation time of a frame and writing it.\n# TYPE ledboard_presentation_delay_seconds histogram\n");
+	histogram(out, size, total, "ledboard_presentation_delay_seconds", "", presentation_delay);
+
+	counter(out, size, total, "ledboard_sync_frames_total", "Prepared frames started by a sync pulse.", load(sync_frames));
+	counter(out, size, total, "ledboard_sync_frames_missed_total", "Sync pulses for a frame that was not prepared.", load(sync_frames_missed));
+	counter(out, size, total, "ledboard_sync_frames_unused_total", "Prepared frames replaced before their sync pulse.", load(sync_frames_unused));
+	append(out, size, total, "# HELP ledboard_sync_latency_seconds Time from a sync pulse to the start of its frame.\n# TYPE ledboard_sync_latency_seconds histogram\n");
+	histogram(out, size, total, "ledboard_sync_latency_seconds", "", sync_latency);
+	gauge(out, size, total, "ledboard_sync_frame", "Number of the last frame started by a sync pulse.", load(sync_frame));
+	gauge(out, size, total, "ledboard_sync_sent_seconds", "Send time of the last sync pulse on the sender's clock.", load(sync_sent) / 1e9);
+	gauge(out, size, total, "ledboard_sync_received_seconds", "Monotonic time the last sync pulse was received.", load(sync_received) / 1e9);
+	gauge(out, size, total, "ledboard_sync_started_seconds", "Monotonic time the last synced frame started.", load(sync_started) / 1e9);
+
+	counter(out, size, total, "ledboard_dmx_universes_total", "sACN and Art-Net universes received.", load(dmx_universes));
+	counter(out, size, total, "ledboard_dmx_universes_unmapped_total", "Universes received that are not in the mapping table.", load(dmx_universes_unmapped));
+	counter(out, size, total, "ledboard_dmx_syncs_total", "sACN and Art-Net sync packets received.", load(dmx_syncs));
+	counter(out, size, total, "ledboard_dmx_frames_total", "Frames written from dmx universes.", load(dmx_frames));
+	counter(out, size, total, "ledboard_dmx_errors_total", "Malformed sACN and Art-Net packets.", load(dmx_errors));
+
+	return total;
+}
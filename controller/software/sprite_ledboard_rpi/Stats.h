@@ -0,0 +1,107 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// number of log2 buckets in a histogram, the last bucket holds everything above 2^30 ns
+#define STATS_BUCKETS 32
+// one in STATS_SAMPLE_RATE packets has its commands timed, must be a power of 2
+#define STATS_SAMPLE_RATE 16
+
+// histogram of durations in nanoseconds
+struct Histogram
+{
+	uint64_t buckets[STATS_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+};
+
+// counters for the controller hot paths
+// only the event loop thread writes, so updates are plain relaxed stores:
+// readers in other threads never see torn values and no locked instruction is needed
+struct Stats
+{
+	uint64_t packets_received;
+	uint64_t bytes_received;
+	uint64_t parse_errors[256];
+	uint64_t commands[256];
+	Histogram command_time[256];
+
+	uint64_t frames_transmitted;
+	uint64_t frames_skipped;
+	uint64_t frames_dropped;
+	uint64_t serial_bytes;
+	Histogram write_buffer_time;
+	Histogram frame_time;
+
+	uint64_t fragments_received;
+	uint64_t fragments_stale;
+	uint64_t fragment_blocks_completed;
+	uint64_t fragment_blocks_discarded;
+
+	uint64_t stream_connections;
+	uint64_t stream_bytes;
+	uint64_t stream_blocks;
+	uint64_t stream_pauses;
+	uint64_t shm_frames;
+	uint64_t shm_frames_skipped;
+	uint64_t shm_frames_torn;
+
+	uint64_t jitter_frames_scheduled;
+	uint64_t jitter_frames_late;
+	uint64_t jitter_frames_dropped;
+	Histogram presentation_delay;
+
+	uint64_t sync_frames;
+	uint64_t sync_frames_missed;
+	uint64_t sync_frames_unused;
+	Histogram sync_latency;
+	// the last synced frame, its send time on the sender's clock, and when it was
+	// received and started on the monotonic clock, all in ns
+	uint64_t sync_frame;
+	uint64_t sync_sent;
+	uint64_t sync_received;
+	uint64_t sync_started;
+
+	uint64_t dmx_universes;
+	uint64_t dmx_universes_unmapped;
+	uint64_t dmx_syncs;
+	uint64_t dmx_frames;
+	uint64_t dmx_errors;
+
+	// write the statistics in the prometheus text exposition format
+	// returns the number of bytes written, output that does not fit is cut off
+	size_t format(char* out, size_t size);
+};
+
+extern Stats stats;
+
+static inline void statsAdd(uint64_t& counter, uint64_t value)
+{
+	__atomic_store_n(&counter, counter + value, __ATOMIC_RELAXED);
+}
+
+static inline void statsSet(uint64_t& gauge, uint64_t value)
+{
+	__atomic_store_n(&gauge, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t statsNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void statsRecord(Histogram& histogram, uint64_t ns)
+{
+	int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+	if(bucket >= STATS_BUCKETS) bucket = STATS_BUCKETS - 1;
+	statsAdd(histogram.buckets[bucket], 1);
+	statsAdd(histogram.count, 1);
+	statsAdd(histogram.sum, ns);
+}
+
+#endif //_STATS_H_
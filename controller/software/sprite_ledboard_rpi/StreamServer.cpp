@@ -0,0 +1,257 @@
+#include "StreamServer.h"
+#include "Stats.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+void StreamServer::init(EventLoop* loop, BlockCallback callback)
+{
+	this->loop = loop;
+	this->callback = callback;
+	for(int i = 0; i < STREAM_MAX_CLIENTS; i++)
+	{
+		clients[i].fd = -1;
+		clients[i].ring = 0;
+	}
+}
+
+bool StreamServer::listenOn(int sock)
+{
+	if(listen(sock, STREAM_MAX_CLIENTS) < 0)
+		return false;
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	return loop->addFd(sock, EPOLLIN, &acceptEvent, this);
+}
+
+bool StreamServer::listenTcp(uint16_t port)
+{
+	tcp_sock = socket(AF_INET, SOCK_STREAM, 0);
+	if(tcp_sock < 0)
+		return false;
+
+	int one = 1;
+	setsockopt(tcp_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if(bind(tcp_sock, (struct sockaddr*)&addr, sizeof addr) < 0)
+	{
+		printf("Error binding to tcp port %d!\n", port);
+		return false;
+	}
+	return listenOn(tcp_sock);
+}
+
+bool StreamServer::listenUnix(const char* path)
+{
+	unix_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(unix_sock < 0)
+		return false;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof addr.sun_path)
+		return false;
+	strcpy(addr.sun_path, path);
+	// remove the socket of a previous run
+	unlink(path);
+	if(bind(unix_sock, (struct sockaddr*)&addr, sizeof addr) < 0)
+	{
+		printf("Error binding to %s!\n", path);
+		return false;
+	}
+	return listenOn(unix_sock);
+}
+
+// map the same memory twice in a row
+uint8_t* StreamServer::mapRing()
+{
+	int fd = memfd_create("ledboard-stream", 0);
+	if(fd < 0)
+		return 0;
+	if(ftruncate(fd, STREAM_RING_SIZE) < 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	uint8_t* base = (uint8_t*)mmap(0, 2 * STREAM_RING_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(base == MAP_FAILED)
+	{
+		close(fd);
+		return 0;
+	}
+	if(mmap(base, STREAM_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+		mmap(base + STREAM_RING_SIZE, STREAM_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+	{
+		munmap(base, 2 * STREAM_RING_SIZE);
+		close(fd);
+		return 0;
+	}
+	close(fd);
+	return base;
+}
+
+void StreamServer::acceptEvent(int fd, uint32_t events, void* ctx)
+{
+	((StreamServer*)ctx)->accept(fd);
+}
+
+void StreamServer::clientEvent(int fd, uint32_t events, void* ctx)
+{
+	StreamServer* server = (StreamServer*)ctx;
+	for(int i = 0; i < STREAM_MAX_CLIENTS; i++)
+	{
+		if(server->clients[i].fd == fd)
+		{
+			server->read(&server->clients[i]);
+			return;
+		}
+	}
+}
+
+void StreamServer::accept(int listen_fd)
+{
+	int fd = ::accept4(listen_fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if(fd < 0)
+		return;
+
+	Client* client = 0;
+	for(int i = 0; i < STREAM_MAX_CLIENTS; i++)
+	{
+		if(clients[i].fd < 0)
+		{
+			client = &clients[i];
+			break;
+		}
+	}
+	if(!client)
+	{
+		printf("Too many stream connections!\n");
+		close(fd);
+		return;
+	}
+
+	// rings are kept when a client disconnects and reused for the next one
+	if(!client->ring && !(client->ring = mapRing()))
+	{
+		printf("Error allocating stream buffer!\n");
+		close(fd);
+		return;
+	}
+
+	if(listen_fd == tcp_sock)
+	{
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+	}
+
+	client->fd = fd;
+	client->head = client->tail = 0;
+	if(!loop->addFd(fd, paused ? 0 : EPOLLIN, &clientEvent, this))
+	{
+		close(fd);
+		client->fd = -1;
+		return;
+	}
+	statsAdd(stats.stream_connections, 1);
+}
+
+void StreamServer::read(Client* client)
+{
+	uint32_t used = client->tail - client->head;
+	uint32_t space = STREAM_RING_SIZE - used;
+	if(space > 0)
+	{
+		// thanks to the second mapping the free space is always contiguous
+		ssize_t len = ::read(client->fd, client->ring + client->tail % STREAM_RING_SIZE, space);
+		if(len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR))
+		{
+			disconnect(client);
+			return;
+		}
+		if(len > 0)
+		{
+			client->tail += len;
+			statsAdd(stats.stream_bytes, len);
+		}
+	}
+	parse(client);
+}
+
+// hand out every complete block, blocks are processed in place
+void StreamServer::parse(Client* client)
+{
+	while(!paused)
+	{
+		uint32_t used = client->tail - client->head;
+		if(used < 2)
+			break;
+		const uint8_t* block = client->ring + client->head % STREAM_RING_SIZE;
+		uint16_t len = (block[0] << 8) | block[1];
+		if(used < 2u + len)
+			break;
+		client->head += 2 + len;
+		statsAdd(stats.stream_blocks, 1);
+		current = client;
+		callback(block + 2, len);
+		current = 0;
+	}
+	// keep the counters small, the offsets only matter modulo the ring size
+	if(client->head >= STREAM_RING_SIZE)
+	{
+		client->head -= STREAM_RING_SIZE;
+		client->tail -= STREAM_RING_SIZE;
+	}
+}
+
+void StreamServer::reply(const uint8_t* data, uint16_t len)
+{
+	if(!current)
+		return;
+	uint8_t prefix[2] = { (uint8_t)(len >> 8), (uint8_t)len };
+	struct iovec iov[2] = { { prefix, 2 }, { (void*)data, len } };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	sendmsg(current->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+void StreamServer::disconnect(Client* client)
+{
+	loop->removeFd(client->fd);
+	close(client->fd);
+	client->fd = -1;
+}
+
+void StreamServer::setPaused(bool pause)
+{
+	if(paused == pause)
+		return;
+	paused = pause;
+	if(paused)
+		statsAdd(stats.stream_pauses, 1);
+
+	for(int i = 0; i < STREAM_MAX_CLIENTS; i++)
+	{
+		Client* client = &clients[i];
+		if(client->fd < 0)
+			continue;
+		// blocks that were left in the ring when the output filled up, this can pause again
+		if(!paused)
+			parse(client);
+		loop->modifyFd(client->fd, paused ? 0 : EPOLLIN);
+	}
+}
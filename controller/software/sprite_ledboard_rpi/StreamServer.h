@@ -0,0 +1,64 @@
+#ifndef _STREAM_SERVER_H_
+#define _STREAM_SERVER_H_
+
+#include <stdint.h>
+#include "EventLoop.h"
+
+// number of stream connections at the same time
+#define STREAM_MAX_CLIENTS 8
+// receive ring per connection, must be a multiple of the page size and hold the largest block,
+// a 2 byte length prefix and 65535 bytes, so every length a prefix can give fits
+#define STREAM_RING_SIZE (128 * 1024)
+
+// called for every complete block received on a stream
+typedef void (*BlockCallback)(const uint8_t* data, uint16_t len);
+
+// accepts LMCP over tcp and unix domain stream sockets
+// every block is prefixed with its length as a big endian uint16_t
+class StreamServer
+{
+public:
+	StreamServer() : loop(0), callback(0), tcp_sock(-1), unix_sock(-1), paused(false), current(0) {};
+
+	void init(EventLoop* loop, BlockCallback callback);
+	bool listenTcp(uint16_t port);
+	bool listenUnix(const char* path);
+
+	// stop reading while the output can not keep up, resuming processes the buffered blocks first
+	void setPaused(bool pause);
+
+	// answer the connection of the block that is being processed, with a length prefix
+	// replies that do not fit in the socket buffer are dropped
+	void reply(const uint8_t* data, uint16_t len);
+
+private:
+	struct Client
+	{
+		int fd;
+		// ring mapped twice in a row, so a block that wraps around is still contiguous
+		uint8_t* ring;
+		uint32_t head;
+		uint32_t tail;
+	};
+
+	EventLoop* loop;
+	BlockCallback callback;
+	int tcp_sock;
+	int unix_sock;
+	bool paused;
+	Client clients[STREAM_MAX_CLIENTS];
+	// connection of the block in the callback
+	Client* current;
+
+	static void acceptEvent(int fd, uint32_t events, void* ctx);
+	static void clientEvent(int fd, uint32_t events, void* ctx);
+	static uint8_t* mapRing();
+
+	bool listenOn(int sock);
+	void accept(int listen_fd);
+	void read(Client* client);
+	void parse(Client* client);
+	void disconnect(Client* client);
+};
+
+#endif //_STREAM_SERVER_H_
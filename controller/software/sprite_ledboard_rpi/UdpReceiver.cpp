@@ -0,0 +1,136 @@
+#include "UdpReceiver.h"
+#include "defines.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+// create the socket and allocate the receive slots
+bool UdpReceiver::open(uint16_t port, int batch_size, int rcvbuf, const char* group)
+{
+	if(batch_size < 1) batch_size = 1;
+	if(batch_size > RECV_BATCH_MAX) batch_size = RECV_BATCH_MAX;
+	batch = batch_size;
+
+	packets = bytes = batches = truncated = errors = 0;
+
+	slots = (uint8_t*)malloc(batch * RECV_SLOT_SIZE);
+	msgs = (struct mmsghdr*)calloc(batch, sizeof *msgs);
+	iovecs = (struct iovec*)calloc(batch, sizeof *iovecs);
+	addrs = (struct sockaddr_in*)calloc(batch, sizeof *addrs);
+	if(!slots || !msgs || !iovecs || !addrs)
+	{
+		printf("Error allocating receive buffers!\n");
+		close();
+		return false;
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock < 0)
+	{
+		printf("Error creating socket!\n");
+		close();
+		return false;
+	}
+
+	if(rcvbuf > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf) < 0)
+	{
+		printf("Error setting receive buffer size!\n");
+	}
+
+	// every controller on the host receives the group's datagrams
+	int reuse = 1;
+	if(group && setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse) < 0)
+	{
+		printf("Error setting address reuse!\n");
+	}
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if(bind(sock, (struct sockaddr*)&addr, sizeof addr) < 0)
+	{
+		printf("Error binding to port %d!\n", port);
+		close();
+		return false;
+	}
+
+	if(group && !join(group))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void UdpReceiver::close()
+{
+	if(sock >= 0)
+		::close(sock);
+	sock = -1;
+	free(slots);
+	free(msgs);
+	free(iovecs);
+	free(addrs);
+	slots = 0;
+	msgs = 0;
+	iovecs = 0;
+	addrs = 0;
+}
+
+bool UdpReceiver::join(const char* group)
+{
+	struct ip_mreq mreq;
+	memset(&mreq, 0, sizeof mreq);
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if(inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1 ||
+		setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof mreq) < 0)
+	{
+		printf("Error joining multicast group %s!\n", group);
+		return false;
+	}
+	return true;
+}
+
+// drain up to batch datagrams with a single system call
+int UdpReceiver::receive(DatagramCallback callback, bool wait)
+{
+	// the kernel overwrites the lengths, so reset them every call
+	for(int i = 0; i < batch; i++)
+	{
+		iovecs[i].iov_base = slots + i * RECV_SLOT_SIZE;
+		iovecs[i].iov_len = RECV_SLOT_SIZE;
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof addrs[i];
+	}
+
+	int count = recvmmsg(sock, msgs, batch, wait ? MSG_WAITFORONE : MSG_DONTWAIT, 0);
+	if(count < 0)
+	{
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return 0;
+		errors++;
+		return -1;
+	}
+
+	batches++;
+	for(int i = 0; i < count; i++)
+	{
+		unsigned int len = msgs[i].msg_len;
+		if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+		{
+			truncated++;
+			continue;
+		}
+		packets++;
+		bytes += len;
+		callback((const uint8_t*)iovecs[i].iov_base, len, &addrs[i]);
+	}
+	return count;
+}
@@ -0,0 +1,54 @@
+#ifndef _UDP_RECEIVER_H_
+#define _UDP_RECEIVER_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// largest possible udp payload
+#define RECV_SLOT_SIZE 65536
+// default and maximum number of datagrams drained per recvmmsg call
+#define RECV_BATCH_DEFAULT 16
+#define RECV_BATCH_MAX 64
+
+// called for every received datagram, in arrival order
+typedef void (*DatagramCallback)(const uint8_t* data, uint16_t len, const struct sockaddr_in* src);
+
+class UdpReceiver
+{
+public:
+	UdpReceiver() : sock(-1), batch(0), slots(0), msgs(0), iovecs(0), addrs(0) {};
+	~UdpReceiver() {};
+
+	// bind to port, rcvbuf <= 0 keeps the kernel default receive buffer
+	// with a multicast group the port can be shared with other processes on the host
+	bool open(uint16_t port, int batch_size, int rcvbuf, const char* group = 0);
+	// close the socket and free the receive slots
+	void close();
+	int fd() { return sock; }
+	// receive a multicast group in addition to the ones already joined
+	bool join(const char* group);
+
+	// receive up to batch datagrams, waits for the first one if wait is set
+	// returns the number of datagrams handled, or -1 on error
+	int receive(DatagramCallback callback, bool wait);
+
+	// counters
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t batches;
+	uint64_t truncated;
+	uint64_t errors;
+
+private:
+	int sock;
+	int batch;
+
+	// preallocated receive slots, reused for every batch
+	uint8_t* slots;
+	struct mmsghdr* msgs;
+	struct iovec* iovecs;
+	struct sockaddr_in* addrs;
+};
+
+#endif //_UDP_RECEIVER_H_
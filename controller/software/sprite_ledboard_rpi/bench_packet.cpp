@@ -0,0 +1,136 @@
+// throughput of LedBoard::processPacket for representative packets, the output goes nowhere
+//
+//	make bench && ./bench_packet [seconds per case]
+//
+// every case runs for the same time, the numbers are per packet so a change in the
+// parse or draw path shows up directly
+
+#include "LedBoard.h"
+#include "Stats.h"
+#include "defines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static LedBoard board;
+
+struct BenchCase
+{
+	const char* name;
+	uint8_t data[8192];
+	uint16_t len;
+};
+
+static BenchCase cases[5];
+static int case_count;
+
+static BenchCase* addCase(const char* name)
+{
+	BenchCase* bench = &cases[case_count++];
+	bench->name = name;
+	bench->len = 0;
+	return bench;
+}
+
+static void add(BenchCase* bench, const uint8_t* data, uint16_t len)
+{
+	memcpy(bench->data + bench->len, data, len);
+	bench->len += len;
+}
+
+static void addByte(BenchCase* bench, uint8_t value)
+{
+	bench->data[bench->len++] = value;
+}
+
+static void buildCases()
+{
+	// a whole frame as 6 row blocks, and the write
+	BenchCase* bench = addCase("full frame 0x10 x6 + 0x01");
+	for(int y = 0; y < 6; y++)
+	{
+		addByte(bench, 0x10);
+		addByte(bench, y);
+		for(int i = 0; i < 96 * 8; i++)
+			addByte(bench, (i * 7 + y) & 0xff);
+	}
+	addByte(bench, 0x01);
+
+	// sprites: 16 small rectangles without a write
+	bench = addCase("0x11 8x8 rectangles x16");
+	for(int i = 0; i < 16; i++)
+	{
+		uint8_t header[5] = { 0x11, (uint8_t)(i * 6), (uint8_t)(i * 2), 8, 8 };
+		add(bench, header, sizeof header);
+		for(int j = 0; j < 64; j++)
+			addByte(bench, j * 4);
+	}
+
+	// a screen of text, one line per command
+	bench = addCase("text 0x20 lines x6");
+	for(int y = 0; y < 6; y++)
+	{
+		uint8_t header[4] = { 0x20, 0, (uint8_t)y, 0xff };
+		add(bench, header, sizeof header);
+		add(bench, (const uint8_t*)"TkkrLab ledboard", 17);
+	}
+
+	// a typical dashboard update mixing commands
+	bench = addCase("mixed 0x30 0x34 0x36 0x21 0x11 0x01");
+	const uint8_t mixed[] = {
+		0x30, 0, 0, 96, 48, 0,
+		0x34, 0, 0, 95, 47, 0xff,
+		0x34, 0, 47, 95, 0, 0xff,
+		0x36, 48, 24, 20, 0x80, 0,
+		0x21, 2, 2, 0xff, 'h', 'e', 'l', 'l', 'o', 0,
+		0x11, 80, 32, 4, 4,
+	};
+	add(bench, mixed, sizeof mixed);
+	for(int j = 0; j < 16; j++)
+		addByte(bench, 0xff);
+	addByte(bench, 0x01);
+
+	// only the encode of a frame for the serial port
+	bench = addCase("write 0x01");
+	addByte(bench, 0x01);
+}
+
+int main(int argc, char* argv[])
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+	board.init(0);
+	buildCases();
+
+	printf("%-40s %12s %12s %10s\n", "case", "ns/packet", "packets/s", "MB/s");
+	for(int i = 0; i < case_count; i++)
+	{
+		BenchCase* bench = &cases[i];
+		// warm up the caches and the page tables
+		for(int j = 0; j < 100; j++)
+			board.processPacket(bench->data, bench->len);
+
+		uint64_t packets = 0;
+		uint64_t start = statsNow();
+		uint64_t end = start + (uint64_t)(seconds * NS_PER_SEC);
+		uint64_t now;
+		do
+		{
+			// check the clock every 64 packets, it is not free either
+			for(int j = 0; j < 64; j++)
+			{
+				if(!board.processPacket(bench->data, bench->len))
+				{
+					printf("%s: packet rejected\n", bench->name);
+					return 1;
+				}
+			}
+			packets += 64;
+			now = statsNow();
+		} while(now < end);
+
+		double elapsed = (double)(now - start);
+		printf("%-40s %12.1f %12.0f %10.1f\n", bench->name, elapsed / packets,
+			packets * 1e9 / elapsed, packets * bench->len * 1e3 / elapsed);
+	}
+	return 0;
+}
@@ -3,4 +3,21 @@
 
 //#define DEBUG
 
+// serial port the segments are connected to
+#define SERIAL_DEVICE "/dev/ttyAMA0"
+
+// udp port for LMCP
+#define LMCP_PORT 1337
+// multicast group and port for frame sync, shared by all controllers of a sign
+#define SYNC_GROUP "239.255.13.37"
+#define SYNC_PORT 1339
+
+// seconds between printing the receive counters
+#define STATS_INTERVAL 10
+// localhost udp port for statistics requests
+#define STATS_PORT 1338
+
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
 #endif//_DEFINES_H_
\ No newline at end of file
@@ -0,0 +1,99 @@
+// libFuzzer target for LedBoard::processPacket, the output goes nowhere
+//
+//	clang++ -g -O1 -fsanitize=fuzzer,address,undefined -o fuzz_packet fuzz_packet.cpp LedBoard.cpp Stats.cpp
+//	./fuzz_packet corpus/
+//
+// without clang, make fuzz_replay builds the same target with gcc and a small driver:
+// files given on the command line are replayed, without files random packets made of
+// valid command bytes are generated
+
+#include "LedBoard.h"
+#include "Stats.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static LedBoard board;
+
+static void discardReply(const uint8_t* data, uint16_t len)
+{
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	static bool initialized;
+	if(!initialized)
+	{
+		board.init(0);
+		board.setReplyCallback(&discardReply);
+		initialized = true;
+	}
+	if(size > 0xffff)
+		return 0;
+	board.processPacket(data, size);
+	// scheduled frames, as the timer in main would
+	board.present(statsNow());
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint8_t input[0x10000];
+
+// an exact size copy, so the sanitizer sees reads past the end like it does with libFuzzer
+static void runInput(size_t len)
+{
+	uint8_t* copy = (uint8_t*)malloc(len ? len : 1);
+	memcpy(copy, input, len);
+	LLVMFuzzerTestOneInput(copy, len);
+	free(copy);
+}
+
+static const uint8_t commands[] = {
+	0x01, 0x02, 0x03, 0x04, 0x10, 0x11, 0x12, 0x20, 0x21,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x40, 0x50, 0x51, 0x52, 0x53, 0x54, 0x60, 0x61,
+};
+
+int main(int argc, char* argv[])
+{
+	if(argc > 1)
+	{
+		for(int i = 1; i < argc; i++)
+		{
+			FILE* file = fopen(argv[i], "rb");
+			if(!file)
+			{
+				printf("Can not open %s\n", argv[i]);
+				return 1;
+			}
+			size_t len = fread(input, 1, sizeof input, file);
+			fclose(file);
+			runInput(len);
+		}
+		printf("replayed %d inputs\n", argc - 1);
+		return 0;
+	}
+
+	// commands with random arguments, the lengths favour short and truncated packets
+	const char* env = getenv("FUZZ_RUNS");
+	int runs = env ? atoi(env) : 200000;
+	srand(1);
+	for(int run = 0; run < runs; run++)
+	{
+		size_t len = 0;
+		int count = 1 + rand() % 4;
+		for(int i = 0; i < count; i++)
+		{
+			input[len++] = rand() % 16 ? commands[rand() % sizeof commands] : rand();
+			size_t args = rand() % 4 ? rand() % 16 : rand() % 2048;
+			for(size_t j = 0; j < args && len < sizeof input; j++)
+				input[len++] = rand() % 4 ? rand() % 100 : rand();
+		}
+		runInput(len);
+	}
+	printf("ran %d random inputs\n", runs);
+	return 0;
+}
+#endif
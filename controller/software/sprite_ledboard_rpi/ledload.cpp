@@ -0,0 +1,414 @@
+// sends a configurable mix of LMCP datagrams at a target rate from several threads
+// to find the limits of a controller, and compares the sent packets with the ones the
+// controller received when it runs on the same host
+//
+//	./ledboard -d /dev/null &
+//	./ledload -m frame=1,rect=4,text=2,write=1 -r 20000 -t 2 -l 10
+//
+// the datagrams are built before the threads start, sending only picks from the pools
+
+#include "Stats.h"
+#include "defines.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#define LOAD_THREADS_MAX 16
+#define LOAD_BATCH_MAX 256
+// different datagrams per kind, so consecutive packets do not draw the same thing
+#define LOAD_VARIANTS 16
+// the order of kinds within a batch repeats after this many packets
+#define LOAD_SCHEDULE_SIZE 1024
+
+#define X_SIZE 96
+#define Y_SIZE 48
+
+enum LoadKind
+{
+	KIND_FRAME,	// 0x10 for all 6 rows and 0x01
+	KIND_RECT,	// 0x11 rectangle of about the configured size
+	KIND_TEXT,	// 0x20 line of text
+	KIND_WRITE,	// 0x01 alone
+	KIND_COUNT
+};
+
+static const char* kind_names[KIND_COUNT] = { "frame", "rect", "text", "write" };
+
+struct Datagram
+{
+	uint8_t* data;
+	uint16_t len;
+};
+
+static Datagram pools[KIND_COUNT][LOAD_VARIANTS];
+static uint8_t schedule[LOAD_SCHEDULE_SIZE];
+
+// command line options
+static struct sockaddr_in target;
+static int weights[KIND_COUNT] = { 1, 0, 0, 0 };
+static double rate = 0;
+static int thread_count = 1;
+static int batch = 32;
+static int rect_size = 256;
+static double seconds = 10;
+static int stats_port = 0;
+
+// per thread counters, each thread on its own cache line
+struct __attribute__((aligned(64))) LoadThread
+{
+	pthread_t thread;
+	int index;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t errors;
+};
+
+static LoadThread threads[LOAD_THREADS_MAX];
+static volatile bool running = true;
+
+static uint8_t* newDatagram(LoadKind kind, int variant, uint16_t len)
+{
+	pools[kind][variant].len = len;
+	return pools[kind][variant].data = (uint8_t*)malloc(len);
+}
+
+static void buildPools()
+{
+	// rectangles as square as the size allows
+	int width = 1;
+	while((width + 1) * (width + 1) <= rect_size && width < X_SIZE) width++;
+	int height = rect_size / width;
+	if(height > Y_SIZE) height = Y_SIZE;
+	if(height < 1) height = 1;
+
+	for(int v = 0; v < LOAD_VARIANTS; v++)
+	{
+		uint8_t* out = newDatagram(KIND_FRAME, v, 6 * (2 + X_SIZE * 8) + 1);
+		for(int y = 0; y < 6; y++)
+		{
+			*out++ = 0x10;
+			*out++ = y;
+			for(int i = 0; i < X_SIZE * 8; i++)
+				*out++ = (i + v * 16 + y * 32) & 0xff;
+		}
+		*out = 0x01;
+
+		out = newDatagram(KIND_RECT, v, 5 + width * height);
+		out[0] = 0x11;
+		out[1] = (v * 7) % (X_SIZE - width + 1);
+		out[2] = (v * 5) % (Y_SIZE - height + 1);
+		out[3] = width;
+		out[4] = height;
+		for(int i = 0; i < width * height; i++)
+			out[5 + i] = (i * 3 + v * 11) & 0xff;
+
+		char text[32];
+		int text_len = snprintf(text, sizeof text, "load %02d %08x", v, v * 0x9e3779b9u);
+		out = newDatagram(KIND_TEXT, v, 4 + text_len + 1);
+		out[0] = 0x20;
+		out[1] = 0;
+		out[2] = v % 6;
+		out[3] = 0xff;
+		memcpy(out + 4, text, text_len + 1);
+
+		out = newDatagram(KIND_WRITE, v, 1);
+		out[0] = 0x01;
+	}
+
+	// spread the kinds evenly by their weight, a kind is picked where it is furthest behind
+	int total = 0;
+	for(int k = 0; k < KIND_COUNT; k++)
+		total += weights[k];
+	int credit[KIND_COUNT] = { 0 };
+	for(int i = 0; i < LOAD_SCHEDULE_SIZE; i++)
+	{
+		int best = 0;
+		for(int k = 0; k < KIND_COUNT; k++)
+		{
+			credit[k] += weights[k];
+			if(credit[k] > credit[best])
+				best = k;
+		}
+		credit[best] -= total;
+		schedule[i] = best;
+	}
+}
+
+static void* sendThread(void* arg)
+{
+	LoadThread* self = (LoadThread*)arg;
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock < 0 || connect(sock, (struct sockaddr*)&target, sizeof target) < 0)
+	{
+		printf("Error creating socket!\n");
+		return 0;
+	}
+
+	struct mmsghdr msgs[LOAD_BATCH_MAX];
+	struct iovec iovecs[LOAD_BATCH_MAX];
+	memset(msgs, 0, sizeof msgs);
+	for(int i = 0; i < batch; i++)
+	{
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// every thread starts at another place in the schedule
+	uint32_t position = self->index * (LOAD_SCHEDULE_SIZE / thread_count);
+	double thread_rate = rate / thread_count;
+	uint64_t start = statsNow();
+	uint64_t sent = 0;
+	while(running)
+	{
+		// the batch is due when the packets before it would have been sent at the target rate
+		if(thread_rate > 0)
+		{
+			uint64_t due = start + (uint64_t)(sent * 1e9 / thread_rate);
+			struct timespec ts = { (time_t)(due / NS_PER_SEC), (long)(due % NS_PER_SEC) };
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+		}
+
+		for(int i = 0; i < batch; i++)
+		{
+			uint8_t kind = schedule[(position + i) % LOAD_SCHEDULE_SIZE];
+			Datagram* datagram = &pools[kind][((position + i) / LOAD_SCHEDULE_SIZE + i) % LOAD_VARIANTS];
+			iovecs[i].iov_base = datagram->data;
+			iovecs[i].iov_len = datagram->len;
+		}
+
+		int done = sendmmsg(sock, msgs, batch, 0);
+		if(done < 0)
+		{
+			// ENOBUFS and ECONNREFUSED (no controller yet) are counted, the batch is skipped
+			statsAdd(self->errors, 1);
+			done = batch;
+		}
+		else
+		{
+			uint64_t bytes = 0;
+			for(int i = 0; i < done; i++)
+				bytes += iovecs[i].iov_len;
+			statsAdd(self->packets, done);
+			statsAdd(self->bytes, bytes);
+		}
+		position += done;
+		sent += done;
+	}
+	close(sock);
+	return 0;
+}
+
+static void sum(uint64_t* packets, uint64_t* bytes, uint64_t* errors)
+{
+	*packets = *bytes = *errors = 0;
+	for(int i = 0; i < thread_count; i++)
+	{
+		*packets += __atomic_load_n(&threads[i].packets, __ATOMIC_RELAXED);
+		*bytes += __atomic_load_n(&threads[i].bytes, __ATOMIC_RELAXED);
+		*errors += __atomic_load_n(&threads[i].errors, __ATOMIC_RELAXED);
+	}
+}
+
+static char reply[65507];
+
+// read one counter from the controller's statistics port, false if it does not answer
+static bool readCounter(const char* name, uint64_t* value)
+{
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(stats_port);
+	struct timeval timeout = { 1, 0 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+	sendto(sock, "", 0, 0, (struct sockaddr*)&addr, sizeof addr);
+	ssize_t len = recv(sock, reply, sizeof reply - 1, 0);
+	close(sock);
+	if(len < 0)
+		return false;
+	reply[len] = 0;
+
+	size_t name_len = strlen(name);
+	for(char* line = reply; line; line = strchr(line, '\n'))
+	{
+		if(*line == '\n') line++;
+		if(strncmp(line, name, name_len) == 0 && line[name_len] == ' ')
+		{
+			*value = strtoull(line + name_len + 1, 0, 10);
+			return true;
+		}
+	}
+	return false;
+}
+
+// "frame=1,rect=4": weights of the kinds, kinds that are not named are not sent
+static bool parseMix(char* mix)
+{
+	for(int k = 0; k < KIND_COUNT; k++)
+		weights[k] = 0;
+	for(char* item = strtok(mix, ","); item; item = strtok(0, ","))
+	{
+		char* value = strchr(item, '=');
+		if(value) *value++ = 0;
+		int k = 0;
+		while(k < KIND_COUNT && strcmp(item, kind_names[k])) k++;
+		if(k == KIND_COUNT)
+			return false;
+		weights[k] = value ? atoi(value) : 1;
+		if(weights[k] < 0)
+			return false;
+	}
+	for(int k = 0; k < KIND_COUNT; k++)
+	{
+		if(weights[k])
+			return true;
+	}
+	return false;
+}
+
+static bool parseTarget(char* host)
+{
+	memset(&target, 0, sizeof target);
+	target.sin_family = AF_INET;
+	target.sin_port = htons(LMCP_PORT);
+	char* port = strchr(host, ':');
+	if(port)
+	{
+		*port = 0;
+		target.sin_port = htons(atoi(port + 1));
+	}
+	struct hostent* entry = gethostbyname(host);
+	if(!entry || entry->h_addrtype != AF_INET)
+		return false;
+	memcpy(&target.sin_addr, entry->h_addr_list[0], 4);
+	return true;
+}
+
+static void usage(const char* name)
+{
+	printf("Usage: %s [-h host[:port]] [-m mix] [-r rate] [-t threads] [-b batch] [-s size] [-l seconds] [-S port]\n", name);
+	printf("  -h host       controller to send to (default 127.0.0.1:%d)\n", LMCP_PORT);
+	printf("  -m mix        kinds of datagrams and their weights, from frame (0x10 x6 + 0x01),\n");
+	printf("                rect (0x11), text (0x20) and write (0x01) (default frame=1)\n");
+	printf("  -r rate       datagrams per second for all threads together (default 0: as fast as possible)\n");
+	printf("  -t threads    sending threads, each with its own socket (1-%d, default 1)\n", LOAD_THREADS_MAX);
+	printf("  -b batch      datagrams per sendmmsg call (1-%d, default 32)\n", LOAD_BATCH_MAX);
+	printf("  -s size       pixels in a rectangle (default 256)\n");
+	printf("  -l seconds    how long to send (default 10)\n");
+	printf("  -S port       compare with the packets received by a controller on this host, read\n");
+	printf("                from its statistics port (default: off, the controller uses %d)\n", STATS_PORT);
+}
+
+int main(int argc, char* argv[])
+{
+	char default_target[] = "127.0.0.1";
+	parseTarget(default_target);
+
+	int opt;
+	while((opt = getopt(argc, argv, "h:m:r:t:b:s:l:S:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'h':
+				if(!parseTarget(optarg))
+				{
+					printf("Unknown host: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'm':
+				if(!parseMix(optarg))
+				{
+					printf("Invalid mix\n");
+					return 1;
+				}
+				break;
+			case 'r': rate = atof(optarg); break;
+			case 't': thread_count = atoi(optarg); break;
+			case 'b': batch = atoi(optarg); break;
+			case 's': rect_size = atoi(optarg); break;
+			case 'l': seconds = atof(optarg); break;
+			case 'S': stats_port = atoi(optarg); break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if(thread_count < 1 || thread_count > LOAD_THREADS_MAX || batch < 1 || batch > LOAD_BATCH_MAX ||
+		rect_size < 1 || rect_size > X_SIZE * Y_SIZE || rate < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	buildPools();
+
+	uint64_t received_before = 0;
+	bool compare = stats_port && readCounter("ledboard_packets_received_total", &received_before);
+	if(stats_port && !compare)
+	{
+		printf("No statistics on port %d, only the send rate is reported\n", stats_port);
+	}
+
+	uint64_t start = statsNow();
+	for(int i = 0; i < thread_count; i++)
+	{
+		threads[i].index = i;
+		pthread_create(&threads[i].thread, 0, &sendThread, &threads[i]);
+	}
+
+	// one line per second
+	uint64_t last_packets = 0, last_bytes = 0, last_time = start;
+	uint64_t end = start + (uint64_t)(seconds * NS_PER_SEC);
+	uint64_t next = start;
+	while(next < end)
+	{
+		next = next + NS_PER_SEC < end ? next + NS_PER_SEC : end;
+		struct timespec ts = { (time_t)(next / NS_PER_SEC), (long)(next % NS_PER_SEC) };
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+
+		uint64_t packets, bytes, errors;
+		sum(&packets, &bytes, &errors);
+		uint64_t now = statsNow();
+		double elapsed = (now - last_time) / 1e9;
+		printf("%6.1f s: %10.0f packets/s %8.1f MB/s %llu send errors\n", (now - start) / 1e9,
+			(packets - last_packets) / elapsed, (bytes - last_bytes) / elapsed / 1e6, (unsigned long long)errors);
+		fflush(stdout);
+		last_packets = packets;
+		last_bytes = bytes;
+		last_time = now;
+	}
+
+	running = false;
+	for(int i = 0; i < thread_count; i++)
+		pthread_join(threads[i].thread, 0);
+
+	uint64_t packets, bytes, errors;
+	sum(&packets, &bytes, &errors);
+	double elapsed = (statsNow() - start) / 1e9;
+	printf("sent %llu packets, %llu bytes in %.2f s: %.0f packets/s, %.1f MB/s, %llu send errors\n",
+		(unsigned long long)packets, (unsigned long long)bytes, elapsed,
+		packets / elapsed, bytes / elapsed / 1e6, (unsigned long long)errors);
+
+	if(compare)
+	{
+		// give the controller time to drain its socket
+		usleep(200000);
+		uint64_t received_after = received_before;
+		readCounter("ledboard_packets_received_total", &received_after);
+		uint64_t received = received_after - received_before;
+		printf("controller received %llu packets: %.0f packets/s, %.1f%% lost\n",
+			(unsigned long long)received, received / elapsed,
+			packets ? (packets > received ? packets - received : 0) * 100.0 / packets : 0);
+	}
+	return 0;
+}
@@ -0,0 +1,61 @@
+// draws an animation with LmcpClient: the whole frame is drawn into the canvas every
+// time, only the changes are sent, and a frame is only sent when the controller has a
+// credit for it, so none are merged on the serial link
+//
+//	./ledboard &
+//	./lmcp_demo [host[:port]] [frames]
+
+#include "LmcpClient.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static LmcpClient client;
+
+int main(int argc, char* argv[])
+{
+	const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+	int frames = argc > 2 ? atoi(argv[2]) : 200;
+	if(!client.open(host))
+		return 1;
+
+	uint8_t* canvas = client.canvas();
+	for(int frame = 0; frame < frames; frame++)
+	{
+		// a static background with a ball moving over it, and a counter
+		for(int y = 0; y < LMCP_HEIGHT; y++)
+		{
+			for(int x = 0; x < LMCP_WIDTH; x++)
+				canvas[y * LMCP_WIDTH + x] = ((x / 8 + y / 8) & 1) ? 0x10 : 0;
+		}
+		int ball_x = 48 + 40 * sin(frame * 0.07);
+		int ball_y = 24 + 18 * cos(frame * 0.11);
+		for(int y = -4; y <= 4; y++)
+		{
+			for(int x = -4; x <= 4; x++)
+			{
+				if(x * x + y * y <= 16)
+					canvas[(ball_y + y) * LMCP_WIDTH + ball_x + x] = 0xff;
+			}
+		}
+		for(int bit = 0; bit < 16; bit++)
+		{
+			canvas[(LMCP_HEIGHT - 1) * LMCP_WIDTH + bit] = (frame >> bit) & 1 ? 0xff : 0;
+		}
+
+		if(!client.waitCredit(1000))
+		{
+			printf("No status reply from %s\n", host);
+			return 1;
+		}
+		client.sendChanges();
+		client.flush();
+	}
+
+	// a full frame is 6 0x10 commands and a write, 4621 bytes
+	printf("%d frames in %llu datagrams, %llu bytes, %.0f bytes per frame instead of 4621\n", frames,
+		(unsigned long long)client.datagrams_sent, (unsigned long long)client.bytes_sent,
+		(double)client.bytes_sent / frames);
+	return 0;
+}
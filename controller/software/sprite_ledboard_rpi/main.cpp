@@ -1,20 +1,99 @@
 #include <stdint.h>
 #include "LedBoard.h"
+#include "UdpReceiver.h"
+#include "EventLoop.h"
+#include "Stats.h"
+#include "SourceTable.h"
+#include "StreamServer.h"
+#include "ShmInput.h"
+#include "DmxInput.h"
+#include "Capture.h"
 #include "tkkrlab_96x48.xbm"
 #include "defines.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/signalfd.h>
 
 static LedBoard board;
+static UdpReceiver receiver;
+static UdpReceiver sync_receiver;
+static EventLoop loop;
+static SourceTable sources;
+static StreamServer streams;
+static ShmInput shm;
+static DmxInput dmx;
+static CaptureWriter capture;
 
-int sock;
+// command line options
+struct Options
+{
+	const char* device;
+	int port;
+	int batch;
+	int rcvbuf;
+	int keepalive_ms;
+	int stats_port;
+	int tcp_port;
+	const char* unix_path;
+	const char* shm_name;
+	const char* sync_group;
+	int sync_port;
+	bool dmx;
+	const char* capture_path;
+	const char* replay_path;
+	double replay_speed;
+	bool device_set;
+};
+static Options options = {
+	SERIAL_DEVICE,
+	LMCP_PORT,
+	RECV_BATCH_DEFAULT,
+	0,
+	0,
+	STATS_PORT,
+	0,
+	0,
+	0,
+	0,
+	SYNC_PORT,
+	false,
+	0,
+	0,
+	1,
+	false,
+};
+
+// whether the serial output can be watched by the event loop
+static bool output_polled;
+
+// socket answering statistics requests
+static int stats_sock = -1;
+// largest reply that fits in a udp datagram
+static char stats_reply[65507];
+
+// packets that processPacket rejected
+static uint64_t packet_errors;
+
+// sender of the datagram that is being processed, 0 for stream blocks
+static const struct sockaddr_in* reply_addr;
+
+// timer for the next frame in the jitter buffer, and the time it is set for
+static int present_timer = -1;
+static uint64_t present_armed;
 
 void udpReceive(uint16_t dest_port, uint8_t src_ip[4], uint16_t src_port, const char *data, uint16_t len)
 {
 	switch(dest_port)
 	{
-		case 1337:
+		case LMCP_PORT:
 		{
 			bool success = board.processPacket((const uint8_t*)data, len);
 			if(!success)
@@ -37,33 +116,479 @@ void udpReceive(uint16_t dest_port, uint8_t src_ip[4], uint16_t src_port, const
 	}
 }
 
+void packetReceive(const uint8_t* data, uint16_t len, const struct sockaddr_in* src)
+{
+	uint64_t now = statsNow();
+	// sync pulses are recorded with the LMCP port, both go to the packet parser
+	capture.record(now, src, options.port, data, len);
+
+	// drop traffic from rate limited or preempted senders before parsing it
+	if(!sources.admit(src, len, now))
+		return;
+
+	statsAdd(stats.packets_received, 1);
+	statsAdd(stats.bytes_received, len);
+	reply_addr = src;
+	if(!board.processPacket(data, len))
+	{
+		packet_errors++;
+	}
+	reply_addr = 0;
+}
+
+// replies go back the way the packet came in
+void packetReply(const uint8_t* data, uint16_t len)
+{
+	if(reply_addr)
+		sendto(receiver.fd(), data, len, MSG_DONTWAIT, (const struct sockaddr*)reply_addr, sizeof *reply_addr);
+	else
+		streams.reply(data, len);
+}
+
+// watch the serial port for writability while there is data left to transmit
+// and stop reading streams while a frame is waiting for the serial port
+void updateOutput()
+{
+	// a shared memory frame waits in the ring until the serial port is free
+	if(!board.outputBusy())
+	{
+		shm.poll();
+	}
+	if(output_polled)
+	{
+		loop.modifyFd(board.outputFd(), board.outputBusy() ? (uint32_t)EPOLLOUT : 0);
+	}
+	streams.setPaused(board.outputQueued());
+
+	// follow the head of the jitter buffer
+	uint64_t next = board.nextPresentation();
+	if(next != present_armed && present_timer >= 0)
+	{
+		uint64_t now = statsNow();
+		// a timer set to 0 is disarmed, frames that are already due fire right away
+		loop.setTimer(present_timer, next ? ((int64_t)(next - now) > 0 ? next - now : 1) : 0, 0);
+		present_armed = next;
+	}
+}
+
+void streamReceive(const uint8_t* data, uint16_t len)
+{
+	capture.record(statsNow(), 0, 0, data, len);
+	statsAdd(stats.packets_received, 1);
+	statsAdd(stats.bytes_received, len);
+	if(!board.processPacket(data, len))
+	{
+		packet_errors++;
+	}
+	updateOutput();
+}
+
+void receiveEvent(int fd, uint32_t events, void* ctx)
+{
+	if(receiver.receive(&packetReceive, false) < 0)
+	{
+		printf("Receive error!\n");
+	}
+	updateOutput();
+}
+
+// sync pulses for every controller of the sign
+void syncEvent(int fd, uint32_t events, void* ctx)
+{
+	if(sync_receiver.receive(&packetReceive, false) < 0)
+	{
+		printf("Sync receive error!\n");
+	}
+	updateOutput();
+}
+
+void outputEvent(int fd, uint32_t events, void* ctx)
+{
+	board.outputFlush();
+	updateOutput();
+}
+
+void presentTimer(uint64_t expirations, void* ctx)
+{
+	present_armed = 0;
+	board.present(statsNow());
+	updateOutput();
+}
+
+// resend the front buffer, for segments that lost their frame
+void keepaliveTimer(uint64_t expirations, void* ctx)
+{
+	board.writeBuffer();
+	updateOutput();
+}
+
+void statsTimer(uint64_t expirations, void* ctx)
+{
+	printf("Recv: %llu packets, %llu bytes, %llu batches, %llu truncated, %llu errors\n",
+		(unsigned long long)receiver.packets,
+		(unsigned long long)receiver.bytes,
+		(unsigned long long)receiver.batches,
+		(unsigned long long)receiver.truncated,
+		(unsigned long long)packet_errors
+	);
+	fflush(stdout);
+	capture.flush();
+}
+
+// stop on SIGINT and SIGTERM so the end of the capture is written
+void signalEvent(int fd, uint32_t events, void* ctx)
+{
+	struct signalfd_siginfo info;
+	if(read(fd, &info, sizeof info) == sizeof info)
+		loop.stop();
+}
+
+// any datagram on the stats port is answered with the statistics
+void statsEvent(int fd, uint32_t events, void* ctx)
+{
+	char request[64];
+	struct sockaddr_in src;
+	socklen_t src_len = sizeof src;
+	if(recvfrom(fd, request, sizeof request, MSG_DONTWAIT, (struct sockaddr*)&src, &src_len) < 0)
+		return;
+	size_t len = stats.format(stats_reply, sizeof stats_reply);
+	len += sources.format(stats_reply + len, sizeof stats_reply - len);
+	sendto(fd, stats_reply, len, MSG_DONTWAIT, (struct sockaddr*)&src, src_len);
+}
+
+// only listen on the loopback interface, the statistics are for local tools
+bool openStatsSocket(uint16_t port)
+{
+	stats_sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(stats_sock < 0)
+		return false;
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if(bind(stats_sock, (struct sockaddr*)&addr, sizeof addr) < 0)
+	{
+		printf("Error binding stats port %d!\n", port);
+		return false;
+	}
+	return loop.addFd(stats_sock, EPOLLIN, &statsEvent, 0);
+}
+
 void setup()
 {
-	board.init();
+	if(options.capture_path && !capture.open(options.capture_path))
+	{
+		exit(1);
+	}
+
+	board.init(options.device);
+	board.setReplyCallback(&packetReply);
 	board.drawXBM((const uint8_t*)&tkkrlab_96x48_bits, sizeof tkkrlab_96x48_bits);
 	board.drawStringNoLen((char*)"TkkrLab Ledboard", 0, 0);
 	board.drawStringNoLen((char*)"Loading...", 0, 5);
 	board.writeBuffer();
 
-	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(!loop.init())
+	{
+		exit(1);
+	}
+	streams.init(&loop, &streamReceive);
+	if(options.capture_path)
+	{
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGINT);
+		sigaddset(&mask, SIGTERM);
+		sigprocmask(SIG_BLOCK, &mask, 0);
+		if(!loop.addFd(signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC), EPOLLIN, &signalEvent, 0))
+		{
+			exit(1);
+		}
+	}
+	present_timer = loop.addTimer(&presentTimer, 0);
+	if(present_timer < 0)
+	{
+		exit(1);
+	}
 
-	struct sockaddr_in addr;
-	memset(&addr, 0, sizeof addr);
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = htonl(INADDR_ANY);
-	addr.sin_port = htons(1337);
-	bind(sock, (struct sockaddr*)&addr, sizeof addr);
+	// regular files can not be polled, write those blocking
+	output_polled = loop.addFd(board.outputFd(), 0, &outputEvent, 0);
+	if(!output_polled)
+	{
+		board.setOutputBlocking();
+		board.outputFlush();
+	}
+	updateOutput();
+
+	if(!receiver.open(options.port, options.batch, options.rcvbuf) || !loop.addFd(receiver.fd(), EPOLLIN, &receiveEvent, 0))
+	{
+		exit(1);
+	}
+
+	if(options.sync_group && (!sync_receiver.open(options.sync_port, 1, 0, options.sync_group) ||
+		!loop.addFd(sync_receiver.fd(), EPOLLIN, &syncEvent, 0)))
+	{
+		exit(1);
+	}
+
+	if(options.tcp_port > 0 && !streams.listenTcp(options.tcp_port))
+	{
+		exit(1);
+	}
+	if(options.unix_path && !streams.listenUnix(options.unix_path))
+	{
+		exit(1);
+	}
+
+	if(options.shm_name && !shm.open(options.shm_name, &loop, &board, &updateOutput))
+	{
+		exit(1);
+	}
+
+	if(options.dmx && !dmx.open(&loop, &board, &sources, &updateOutput, options.capture_path ? &capture : 0))
+	{
+		exit(1);
+	}
+
+	if(options.stats_port > 0 && !openStatsSocket(options.stats_port))
+	{
+		exit(1);
+	}
+
+	int stats_timer = loop.addTimer(&statsTimer, 0);
+	if(stats_timer < 0)
+	{
+		exit(1);
+	}
+	loop.setTimer(stats_timer, STATS_INTERVAL * NS_PER_SEC, STATS_INTERVAL * NS_PER_SEC);
+
+	if(options.keepalive_ms > 0)
+	{
+		int keepalive_timer = loop.addTimer(&keepaliveTimer, 0);
+		if(keepalive_timer < 0)
+		{
+			exit(1);
+		}
+		uint64_t interval = options.keepalive_ms * NS_PER_MS;
+		loop.setTimer(keepalive_timer, interval, interval);
+	}
+}
+
+// replies to replayed packets have nowhere to go
+void replayReply(const uint8_t* data, uint16_t len)
+{
+}
+
+// replayed dmx frames are flipped by DmxInput and written below like every other frame
+void replayOutput()
+{
+}
+
+// feed a capture through processPacket instead of the network, at the recorded pace
+// divided by speed, or as fast as possible with speed 0
+// senders are admitted on the recorded time line, so rate limits and priorities act as
+// they did during the capture at any speed
+int replay()
+{
+	CaptureReader reader;
+	if(!reader.open(options.replay_path))
+	{
+		return 1;
+	}
+
+	// without -d the frames are encoded but not written anywhere
+	board.init(options.device_set ? options.device : 0);
+	board.setReplyCallback(&replayReply);
+	if(options.device_set)
+	{
+		board.setOutputBlocking();
+	}
+	dmx.attach(&board, &sources, &replayOutput);
+
+	uint64_t start = statsNow();
+	uint64_t capture_time = 0;
+	CaptureRecord record;
+	while(reader.next(&record))
+	{
+		capture_time = record.time;
+		if(options.replay_speed > 0)
+		{
+			uint64_t due = start + (uint64_t)(record.time / options.replay_speed);
+			struct timespec ts = { (time_t)(due / NS_PER_SEC), (long)(due % NS_PER_SEC) };
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+		}
+
+		// dmx datagrams are counted by DmxInput, as they are live
+		if(record.port == E131_PORT || record.port == ARTNET_PORT)
+		{
+			dmx.receive(record.port, record.data, record.len, &record.src, start + record.time);
+		}
+		else if(record.stream || sources.admit(&record.src, record.len, start + record.time))
+		{
+			statsAdd(stats.packets_received, 1);
+			statsAdd(stats.bytes_received, record.len);
+			if(!board.processPacket(record.data, record.len))
+			{
+				packet_errors++;
+			}
+		}
+
+		uint64_t now = statsNow();
+		uint64_t next = board.nextPresentation();
+		if(next && next <= now)
+		{
+			board.present(now);
+		}
+		board.outputFlush();
+	}
+	reader.close();
+
+	double elapsed = (statsNow() - start) / 1e9;
+	uint64_t frames = stats.frames_transmitted + stats.frames_skipped;
+	printf("Replayed %llu packets, %llu bytes, %llu errors in %.3f s (capture %.3f s)\n",
+		(unsigned long long)stats.packets_received,
+		(unsigned long long)stats.bytes_received,
+		(unsigned long long)packet_errors,
+		elapsed, capture_time / 1e9);
+	printf("%.0f packets/s, %.1f MB/s, %llu frames (%llu transmitted, %llu merged), %.1f frames/s\n",
+		stats.packets_received / elapsed,
+		stats.bytes_received / elapsed / 1e6,
+		(unsigned long long)frames,
+		(unsigned long long)stats.frames_transmitted,
+		(unsigned long long)stats.frames_skipped,
+		frames / elapsed);
+	return 0;
+}
+
+void usage(const char* name)
+{
+	printf("Usage: %s [-d device] [-p port] [-b batch] [-r rcvbuf] [-k keepalive] [-s port]\n", name);
+	printf("       [-L rate[:burst]] [-P address[:port]=priority ...] [-H hold] [-T port] [-U path]\n");
+	printf("       [-M name] [-m group[:port]] [-E] [-X universe=pixel[:count] ...] [-C file]\n");
+	printf("       %s -R file [-S speed] [-d device] [-L rate[:burst]] [-P rule ...]\n", name);
+	printf("  -d device     serial port or file to write to (default %s)\n", SERIAL_DEVICE);
+	printf("  -p port       udp port for LMCP (default %d)\n", LMCP_PORT);
+	printf("  -b batch      datagrams received per system call (1-%d, default %d)\n", RECV_BATCH_MAX, RECV_BATCH_DEFAULT);
+	printf("  -r rcvbuf     socket receive buffer size in bytes (default: kernel default)\n");
+	printf("  -k keepalive  resend the current frame every keepalive ms (default: off)\n");
+	printf("  -s port       answer statistics requests on localhost udp port (default %d, 0: off)\n", STATS_PORT);
+	printf("  -L rate       limit every sender to rate datagrams per second, with bursts of burst (default: off)\n");
+	printf("  -P rule       give a sender a priority (1-255), a sender with a priority owns the board\n");
+	printf("                while it is active, lower priority senders are ignored (default: 0)\n");
+	printf("  -H hold       seconds a sender keeps ownership after its last datagram (default %d)\n", SOURCE_HOLD_DEFAULT);
+	printf("  -T port       accept length prefixed LMCP blocks on tcp port (default: off)\n");
+	printf("  -U path       accept length prefixed LMCP blocks on a unix socket (default: off)\n");
+	printf("  -M name       accept frames from local producers in shared memory /dev/shm/name (default: off)\n");
+	printf("  -m group      receive frame sync pulses on a multicast group, for signs made of\n");
+	printf("                several boards (default: off, suggested %s:%d)\n", SYNC_GROUP, SYNC_PORT);
+	printf("  -E            receive sACN (E1.31) on udp port %d and Art-Net on udp port %d\n", E131_PORT, ARTNET_PORT);
+	printf("  -X mapping    copy channels of a universe to count pixels from pixel on, row by row\n");
+	printf("                (default: universes 1-9 fill the board, 512 pixels each)\n");
+	printf("  -C file       record every received datagram and stream block to a capture file\n");
+	printf("  -R file       replay a capture through the packet parser and report the throughput,\n");
+	printf("                frames are only written with -d\n");
+	printf("  -S speed      replay at speed times the recorded pace, 0: as fast as possible (default 1)\n");
 }
 
 int main(int argc, char* argv[])
 {
-	setup();
-	char buffer[65535];
-	while(1)
+	int opt;
+	while((opt = getopt(argc, argv, "d:p:b:r:k:s:L:P:H:T:U:M:m:EX:C:R:S:h")) != -1)
 	{
-		int c = recvfrom(sock, buffer, 65535, 0, 0, 0);
-		board.processPacket((const uint8_t*)buffer, c);
-		printf("Recv: %d\n", c);
+		switch(opt)
+		{
+			case 'd':
+				options.device = optarg;
+				options.device_set = true;
+				break;
+			case 'p':
+				options.port = atoi(optarg);
+				break;
+			case 'b':
+				options.batch = atoi(optarg);
+				break;
+			case 'r':
+				options.rcvbuf = atoi(optarg);
+				break;
+			case 'k':
+				options.keepalive_ms = atoi(optarg);
+				break;
+			case 's':
+				options.stats_port = atoi(optarg);
+				break;
+			case 'L':
+			{
+				int rate = atoi(optarg);
+				const char* burst = strchr(optarg, ':');
+				sources.setRateLimit(rate, burst ? atoi(burst + 1) : rate);
+				break;
+			}
+			case 'P':
+				if(!sources.addRule(optarg))
+				{
+					printf("Invalid priority rule: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'H':
+				sources.setHold(atoi(optarg));
+				break;
+			case 'T':
+				options.tcp_port = atoi(optarg);
+				break;
+			case 'U':
+				options.unix_path = optarg;
+				break;
+			case 'M':
+				options.shm_name = optarg;
+				break;
+			case 'E':
+				options.dmx = true;
+				break;
+			case 'X':
+				options.dmx = true;
+				if(!dmx.addMapping(optarg))
+				{
+					printf("Invalid universe mapping: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'C':
+				options.capture_path = optarg;
+				break;
+			case 'R':
+				options.replay_path = optarg;
+				break;
+			case 'S':
+				options.replay_speed = atof(optarg);
+				break;
+			case 'm':
+			{
+				// the group is cut off at the port
+				char* port = strchr(optarg, ':');
+				if(port)
+				{
+					*port = 0;
+					options.sync_port = atoi(port + 1);
+				}
+				options.sync_group = optarg;
+				break;
+			}
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
 	}
+
+	if(options.replay_path)
+	{
+		return replay();
+	}
+
+	setup();
+	loop.run();
+	capture.close();
 	return 0;
 }
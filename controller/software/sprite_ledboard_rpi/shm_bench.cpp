@@ -0,0 +1,89 @@
+// publishes frames into the shared memory ring of a controller as fast as possible
+// and compares the produced rate with the frames the controller took
+//
+//	./ledboard -d /dev/null -M ledboard &
+//	./shm_bench ledboard 5
+
+#include "ShmProducer.h"
+#include "Stats.h"
+#include "defines.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static char reply[65507];
+
+// read one counter from the controller's statistics port
+static uint64_t readCounter(const char* name)
+{
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(STATS_PORT);
+	struct timeval timeout = { 1, 0 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+	sendto(sock, "", 0, 0, (struct sockaddr*)&addr, sizeof addr);
+	ssize_t len = recv(sock, reply, sizeof reply - 1, 0);
+	close(sock);
+	if(len < 0)
+		return 0;
+	reply[len] = 0;
+
+	size_t name_len = strlen(name);
+	for(char* line = reply; line; line = strchr(line, '\n'))
+	{
+		if(*line == '\n') line++;
+		if(strncmp(line, name, name_len) == 0 && line[name_len] == ' ')
+			return strtoull(line + name_len + 1, 0, 10);
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc < 2)
+	{
+		printf("Usage: %s name [seconds]\n", argv[0]);
+		return 1;
+	}
+	int seconds = argc > 2 ? atoi(argv[2]) : 5;
+
+	ShmProducer producer;
+	if(!producer.open(argv[1]))
+	{
+		printf("Can not open shared memory ring %s, is ledboard running with -M %s?\n", argv[1], argv[1]);
+		return 1;
+	}
+
+	uint64_t consumed_start = readCounter("ledboard_shm_frames_total");
+	uint64_t start = statsNow();
+	uint64_t end = start + seconds * NS_PER_SEC;
+	uint64_t frames = 0;
+	uint64_t now;
+	while((now = statsNow()) < end)
+	{
+		// a moving diagonal pattern, every pixel changes each frame
+		uint8_t* pixels = producer.beginFrame();
+		for(int y = 0; y < FRAME_RING_HEIGHT; y++)
+			memset(pixels + y * FRAME_RING_WIDTH, (uint8_t)(frames + y), FRAME_RING_WIDTH);
+		producer.publish();
+		frames++;
+	}
+	// let the controller finish the frame it is sending
+	usleep(100000);
+	uint64_t consumed = readCounter("ledboard_shm_frames_total") - consumed_start;
+	uint64_t torn = readCounter("ledboard_shm_frames_torn_total");
+
+	double elapsed = (double)(now - start) / NS_PER_SEC;
+	printf("produced %llu frames, %.0f fps, %.1f MB/s\n", (unsigned long long)frames, frames / elapsed,
+		frames * sizeof(((FrameSlot*)0)->pixels) / elapsed / 1e6);
+	printf("consumed %llu frames, %.0f fps, %llu torn\n", (unsigned long long)consumed, consumed / elapsed,
+		(unsigned long long)torn);
+	return 0;
+}
@@ -19,7 +19,18 @@ Commands:
 	0x01: write buffer, writes the current framebuffer to the screem
 		no arguments
 	0x02: clear, clears the matrix and writes the current framebuffer to the screen
+		in double buffer mode both the front and the back buffer are cleared
 		no arguments
+	0x03: flip, swaps the front and back buffer and writes the new front buffer to the screen
+		in single buffer mode this is the same as 0x01
+		no arguments
+	0x04: buffer mode
+		* uint8_t mode:
+			0: single buffer, drawing commands write to the displayed buffer (default)
+			1: double buffer, drawing commands write to the back buffer, 0x01 only
+			   writes the front buffer, 0x03 makes the back buffer visible
+			2: double buffer, and copy the front buffer to the back buffer after a flip
+			   so the next frame can be drawn incrementally
 	0x10: draw rows
 		* uint y:
 			y position of the row to draw (0-5)
@@ -36,6 +47,23 @@ Commands:
 			height of pixel data
 		* uint8_t data[width * height]:
 			pixel data
+	0x12: draw scaled image rectangle
+		* uint8_t x:
+			top left x position of the destination rectangle
+		* uint8_t y:
+			top left y position of the destination rectangle
+		* uint8_t width:
+			width of the destination rectangle
+		* uint8_t height:
+			height of the destination rectangle
+		* uint8_t src_width:
+			width of pixel data
+		* uint8_t src_height:
+			height of pixel data
+		* uint8_t mode:
+			resampling filter, 0: nearest, 1: box (average), 2: bilinear
+		* uint8_t data[src_width * src_height]:
+			pixel data
 	0x20: write text line based
 		chars are 5x7 -> 6x8 including space and line separation
 		* uint8_t x:
@@ -59,6 +87,63 @@ Commands:
 			text (ascii)
 		* 0x00:
 			terminator
+	0x30: fill rectangle
+		* uint8_t x, y:
+			top left position in pixels
+		* uint8_t width, height:
+			size of the rectangle
+		* uint8_t brightness:
+			fill value
+	0x31: fill rectangle with a gradient
+		* uint8_t x, y:
+			top left position in pixels
+		* uint8_t width, height:
+			size of the rectangle
+		* uint8_t from, to:
+			brightness at the start and end of the gradient
+		* uint8_t direction:
+			0: left to right, 1: top to bottom
+	0x32: draw horizontal line
+		* uint8_t x, y:
+			start position in pixels
+		* uint8_t length:
+			length of the line towards the right
+		* uint8_t brightness
+	0x33: draw vertical line
+		* uint8_t x, y:
+			start position in pixels
+		* uint8_t length:
+			length of the line downwards
+		* uint8_t brightness
+	0x34: draw line
+		* uint8_t x0, y0:
+			start position in pixels
+		* uint8_t x1, y1:
+			end position in pixels
+		* uint8_t brightness
+	0x35: draw rectangle outline
+		* uint8_t x, y:
+			top left position in pixels
+		* uint8_t width, height:
+			size of the rectangle
+		* uint8_t brightness
+	0x36: draw circle
+		* uint8_t x, y:
+			center position in pixels
+		* uint8_t radius
+		* uint8_t brightness
+		* uint8_t filled:
+			0: outline only, 1: filled
+	0x60: set brightness of the whole board
+		* uint8_t level:
+			0x00 (off) - 0xFF (full), applied by the segments to every frame
+		only 2 bytes are sent to the segments, the frame is not sent again
+	0x61: fade brightness of the whole board
+		* uint8_t level:
+			brightness at the end of the fade
+		* uint16_t duration:
+			length of the fade in milliseconds, at most 10400
+		the segments fade by themselves, the duration is rounded to a multiple of 82 ms
 	
 */
 
@@ -88,10 +173,15 @@ int LedBoard::panel_layout[PANEL_COUNT][2] = {
 // size of board for buffers
 #define TOTAL_SIZE (X_SIZE * Y_SIZE)
 
+// refresh rate of the segments, and the refreshes in a step of a segment fade
+#define SEGMENT_REFRESH_HZ 195
+#define SEGMENT_FADE_STEP 16
+#define SEGMENT_FADE_STEPS_MAX 127
+
 int LedBoard::width = X_SIZE;
 int LedBoard::height = Y_SIZE;
-// buffer that can be written to the matrix
-uint8_t LedBoard::buffer[TOTAL_SIZE];
+// front and back buffer that can be written to the matrix
+uint8_t LedBoard::pages[2 * TOTAL_SIZE];
 // buffer, set at init, keeps track of pixel location to pixel order to send to panels
 uint16_t LedBoard::pixel_map[TOTAL_SIZE];
 
@@ -122,7 +212,8 @@ void LedBoard::init()
 void LedBoard::clear()
 {
 	memset(buffer, 0, width * height);
-	outputStart();
+	if(front != buffer)
+		memset(front, 0, width * height);
 	writeBuffer();
 }
 
@@ -153,6 +244,19 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 				clear();
 				break;
 
+			// flip
+			case 0x03:
+				flip();
+				break;
+
+			// buffer mode
+			case 0x04:
+				if(packet_len - packet_position < 1)
+					return false;
+				if(!setBufferMode(data[packet_position++]))
+					return false;
+				break;
+
 			// draw rows
 			case 0x10:
 			{
@@ -162,7 +266,10 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 
 				uint8_t y = data[packet_position++];
 
-				packet_position += drawImage(0, y * 8, 96, 8, (uint8_t*)data + packet_position);
+				// rows below the board are skipped, y * 8 would wrap around to the top
+				if(y < Y_SIZE / 8)
+					drawImage(0, y * 8, 96, 8, (uint8_t*)data + packet_position);
+				packet_position += 96 * 8;
 
 				break;
 			}
@@ -185,6 +292,31 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 				
 				break;
 			}
+			// draw scaled image rectangle
+			case 0x12:
+			{
+				// 7 bytes for header
+				if(packet_len - packet_position < 7)
+					return false;
+				uint8_t x = data[packet_position++];
+				uint8_t y = data[packet_position++];
+				uint8_t width = data[packet_position++];
+				uint8_t height = data[packet_position++];
+				uint8_t src_width = data[packet_position++];
+				uint8_t src_height = data[packet_position++];
+				uint8_t mode = data[packet_position++];
+
+				if(mode > SCALE_BILINEAR)
+					return false;
+
+				// need enough bytes
+				if(packet_len - packet_position < src_width * src_height)
+					return false;
+
+				packet_position += drawScaledImage(x, y, width, height, src_width, src_height, mode, data + packet_position);
+
+				break;
+			}
 
 			// write text line based
 			case 0x20:
@@ -192,20 +324,107 @@ bool LedBoard::processPacket(const uint8_t* data, uint16_t packet_len)
 			case 0x21:
 			{
 				bool absolute = cmd == 0x21;
+				// 3 bytes for header
+				if(packet_len - packet_position < 3)
+					return false;
 				uint8_t x = data[packet_position++];
 				uint8_t y = data[packet_position++];
 				uint8_t brightness = data[packet_position++];
-				int16_t str_size = strnlen((char*)(data + packet_position), packet_len - packet_position);
-				// string error
-				if(str_size < 0)
-					return false;
-				packet_position += drawString(
+				// the text ends at the terminator, or at the end of the packet
+				uint16_t str_size = strnlen((char*)(data + packet_position), packet_len - packet_position);
+				drawString(
 					(char*)(data + packet_position), 
 					str_size, 
 					x, y, 
 					brightness,
 					absolute
 				);
+				packet_position += str_size;
+				if(packet_position < packet_len)
+					packet_position++;
+				break;
+			}
+			// fill rectangle
+			case 0x30:
+			{
+				if(packet_len - packet_position < 5)
+					return false;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				fillRect(args[0], args[1], args[2], args[3], args[4]);
+				break;
+			}
+			// fill rectangle with a gradient
+			case 0x31:
+			{
+				if(packet_len - packet_position < 7)
+					return false;
+				const uint8_t* args = data + packet_position;
+				packet_position += 7;
+				fillGradient(args[0], args[1], args[2], args[3], args[4], args[5], args[6] != 0);
+				break;
+			}
+			// draw horizontal line
+			case 0x32:
+			// draw vertical line
+			case 0x33:
+			{
+				if(packet_len - packet_position < 4)
+					return false;
+				const uint8_t* args = data + packet_position;
+				packet_position += 4;
+				if(cmd == 0x32)
+					fillRect(args[0], args[1], args[2], 1, args[3]);
+				else
+					fillRect(args[0], args[1], 1, args[2], args[3]);
+				break;
+			}
+			// draw line
+			case 0x34:
+			{
+				if(packet_len - packet_position < 5)
+					return false;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				drawLine(args[0], args[1], args[2], args[3], args[4]);
+				break;
+			}
+			// draw rectangle outline
+			case 0x35:
+			{
+				if(packet_len - packet_position < 5)
+					return false;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				drawRect(args[0], args[1], args[2], args[3], args[4]);
+				break;
+			}
+			// draw circle
+			case 0x36:
+			{
+				if(packet_len - packet_position < 5)
+					return false;
+				const uint8_t* args = data + packet_position;
+				packet_position += 5;
+				drawCircle(args[0], args[1], args[2], args[3], args[4] != 0);
+				break;
+			}
+			// brightness
+			case 0x60:
+			{
+				if(packet_len - packet_position < 1)
+					return false;
+				setBrightness(data[packet_position++]);
+				break;
+			}
+			// fade
+			case 0x61:
+			{
+				if(packet_len - packet_position < 3)
+					return false;
+				const uint8_t* args = data + packet_position;
+				packet_position += 3;
+				fadeBrightness(args[0], (args[1] << 8) | args[2]);
 				break;
 			}
 			// unknown command -> ignore this packet
@@ -224,8 +443,11 @@ uint16_t LedBoard::drawStringNoLen(char* text, uint8_t x_pos, uint8_t y_pos, uin
 
 
 // draw a string at x_pos, y_pos, optionally absolute position
-uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_pos, uint8_t y_pos, uint8_t brightness, bool absolute)
+uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_char, uint8_t y_char, uint8_t brightness, bool absolute)
 {
+	// in pixels, line based positions do not fit in a uint8_t
+	int x_pos = x_char;
+	int y_pos = y_char;
 	if(!absolute)
 	{
 		x_pos *= TEXT_CHAR_WIDTH + 1;
@@ -234,13 +456,14 @@ uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_pos, uint8_t y
 	if(x_pos + TEXT_CHAR_WIDTH >= width) goto writeText_exit;
 	if(y_pos + TEXT_CHAR_HEIGHT >= height) goto writeText_exit;
 
-	for(int i = 0; i < len; i++)
+	// characters past the right edge are not drawn
+	for(int i = 0; i < len && x_pos + (TEXT_CHAR_WIDTH + 1) * i < width; i++)
 	{
 		int char_pos = (text[i] - 0x20);
 		if(char_pos < 0 || char_pos > (0x7f - 0x20)) char_pos = 0;
 		char_pos *= TEXT_CHAR_WIDTH; // 5 byte per char
 
-		// draw 1 extra for the space, it's ok if it overflows there because setPixel will catch that
+		// draw 1 extra for the space, it's ok if it overflows there because setPixelClipped will catch that
 		for(int char_x = 0; char_x < TEXT_CHAR_WIDTH + 1; char_x++)
 		{
 			// this draws a 1 pixel empty column after each character
@@ -250,7 +473,7 @@ uint16_t LedBoard::drawString(char* text, uint16_t len, uint8_t x_pos, uint8_t y
 			for(int k = 0; k < TEXT_CHAR_HEIGHT + 1; k++)
 			{
 				bool on = (c & (1 << k)) != 0;
-				setPixel(
+				setPixelClipped(
 					on ? brightness : 0x00,
 					x_pos + char_x + ((TEXT_CHAR_WIDTH + 1) * i), 
 					y_pos + k
@@ -266,14 +489,274 @@ writeText_exit:
 // draws an image in the specified region
 uint16_t LedBoard::drawImage(uint8_t x, uint8_t y, uint16_t width, uint16_t height, uint8_t* data)
 {
-	for(int y_pos = 0; y_pos < height; y_pos++)
+	// copy the part of every row that is on the board, x + width used to wrap around
+	int visible = x < X_SIZE ? X_SIZE - x : 0;
+	if(visible > width) visible = width;
+	if(visible <= 0)
+		return width * height;
+	for(int y_pos = 0; y_pos < height && y + y_pos < Y_SIZE; y_pos++)
+	{
+		memcpy(buffer + (y + y_pos) * X_SIZE + x, data + y_pos * width, visible);
+	}
+	return width * height;
+}
+
+// draws an image of src_width * src_height resampled to fit the specified region
+// source coordinates are stepped in 16.16 fixed point, bilinear weights are 8 bit
+uint16_t LedBoard::drawScaledImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t src_width, uint8_t src_height, uint8_t mode, const uint8_t* data)
+{
+	uint16_t src_size = src_width * src_height;
+	if(width == 0 || height == 0 || src_size == 0)
+		return src_size;
+
+	// clip the destination rectangle to the board
+	int x_end = x + width > this->width ? this->width : x + width;
+	int y_end = y + height > this->height ? this->height : y + height;
+	if(x >= x_end || y >= y_end)
+		return src_size;
+
+	uint32_t x_step = ((uint32_t)src_width << 16) / width;
+	uint32_t y_step = ((uint32_t)src_height << 16) / height;
+
+	// per column source positions, computed once and reused for every row
+	uint8_t col_start[X_SIZE];
+	uint8_t col_end[X_SIZE];
+	uint8_t col_frac[X_SIZE];
+	for(int x_pos = x; x_pos < x_end; x_pos++)
 	{
-		for(int x_pos = 0; x_pos < width; x_pos++)
+		int i = x_pos - x;
+		scaleSpan(i, x_step, src_width, mode, &col_start[i], &col_end[i], &col_frac[i]);
+	}
+
+	for(int y_pos = y; y_pos < y_end; y_pos++)
+	{
+		uint8_t row_start, row_end, row_frac;
+		scaleSpan(y_pos - y, y_step, src_height, mode, &row_start, &row_end, &row_frac);
+
+		uint8_t* out = buffer + y_pos * this->width + x;
+		const uint8_t* row0 = data + row_start * src_width;
+		const uint8_t* row1 = data + row_end * src_width;
+		int count = x_end - x;
+
+		switch(mode)
 		{
-			setPixel(*data++, x + x_pos, y + y_pos);
+			case SCALE_NEAREST:
+				for(int i = 0; i < count; i++)
+					out[i] = row0[col_start[i]];
+				break;
+
+			case SCALE_BOX:
+			{
+				// row_end and col_end are exclusive here
+				uint16_t rows = row_end - row_start;
+				for(int i = 0; i < count; i++)
+				{
+					uint32_t sum = 0;
+					const uint8_t* src = row0;
+					for(uint16_t r = 0; r < rows; r++, src += src_width)
+					{
+						for(uint16_t c = col_start[i]; c < col_end[i]; c++)
+							sum += src[c];
+					}
+					out[i] = sum / (rows * (col_end[i] - col_start[i]));
+				}
+				break;
+			}
+
+			case SCALE_BILINEAR:
+				for(int i = 0; i < count; i++)
+				{
+					uint16_t fx = col_frac[i];
+					uint16_t top = row0[col_start[i]] * (256 - fx) + row0[col_end[i]] * fx;
+					uint16_t bottom = row1[col_start[i]] * (256 - fx) + row1[col_end[i]] * fx;
+					out[i] = ((uint32_t)top * (256 - row_frac) + (uint32_t)bottom * row_frac) >> 16;
+				}
+				break;
+		}
+	}
+	return src_size;
+}
+
+// map destination index i to the source samples for the given filter
+// nearest: start is the sample, end the same sample
+// box: [start, end) is the covered source range
+// bilinear: start and end are the neighbouring samples, frac the weight of end
+// all three are set for every mode
+void LedBoard::scaleSpan(int i, uint32_t step, uint8_t src_size, uint8_t mode, uint8_t* start, uint8_t* end, uint8_t* frac)
+{
+	*start = *end = *frac = 0;
+	switch(mode)
+	{
+		case SCALE_NEAREST:
+			// sample at the center of the destination pixel
+			*start = *end = (i * step + (step >> 1)) >> 16;
+			break;
+
+		case SCALE_BOX:
+		{
+			uint32_t s = (i * step) >> 16;
+			uint32_t e = ((i + 1) * step + 0xFFFF) >> 16;
+			if(e > src_size) e = src_size;
+			if(e <= s) e = s + 1;
+			*start = s;
+			*end = e;
+			break;
+		}
+
+		case SCALE_BILINEAR:
+		{
+			// center of destination pixel in source space, minus half a source pixel
+			int32_t pos = (int32_t)(i * step + (step >> 1)) - 0x8000;
+			if(pos < 0) pos = 0;
+			uint32_t s = pos >> 16;
+			if(s >= (uint32_t)src_size - 1)
+			{
+				*start = *end = src_size - 1;
+				*frac = 0;
+			}
+			else
+			{
+				*start = s;
+				*end = s + 1;
+				*frac = (pos >> 8) & 0xFF;
+			}
+			break;
+		}
+	}
+}
+
+// fill a rectangle with a single value, clipped to the board
+void LedBoard::fillRect(int x, int y, int width, int height, uint8_t val)
+{
+	if(x < 0) { width += x; x = 0; }
+	if(y < 0) { height += y; y = 0; }
+	if(x + width > this->width) width = this->width - x;
+	if(y + height > this->height) height = this->height - y;
+	if(width <= 0 || height <= 0) return;
+
+	uint8_t* row = buffer + y * this->width + x;
+	for(int i = 0; i < height; i++, row += this->width)
+	{
+		memset(row, val, width);
+	}
+}
+
+// fill a rectangle with a linear gradient from `from` to `to`
+void LedBoard::fillGradient(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t from, uint8_t to, bool vertical)
+{
+	int steps = (vertical ? height : width) - 1;
+	if(steps < 0) return;
+	int delta = to - from;
+
+	if(vertical)
+	{
+		// one value per row
+		for(int i = 0; i <= steps; i++)
+		{
+			uint8_t val = steps ? from + delta * i / steps : from;
+			fillRect(x, y + i, width, 1, val);
+		}
+		return;
+	}
+
+	// build the first visible row, then copy it to the rows below
+	int x_end = x + width > this->width ? this->width : x + width;
+	int y_end = y + height > this->height ? this->height : y + height;
+	if(x >= x_end || y >= y_end) return;
+
+	uint8_t* first = buffer + y * this->width;
+	for(int x_pos = x; x_pos < x_end; x_pos++)
+	{
+		int i = x_pos - x;
+		first[x_pos] = steps ? from + delta * i / steps : from;
+	}
+	for(int y_pos = y + 1; y_pos < y_end; y_pos++)
+	{
+		memcpy(buffer + y_pos * this->width + x, first + x, x_end - x);
+	}
+}
+
+// draw a line from x0, y0 to x1, y1 using bresenham
+void LedBoard::drawLine(int x0, int y0, int x1, int y1, uint8_t val)
+{
+	// straight lines are spans
+	if(y0 == y1)
+	{
+		if(x1 < x0) { int t = x0; x0 = x1; x1 = t; }
+		fillRect(x0, y0, x1 - x0 + 1, 1, val);
+		return;
+	}
+	if(x0 == x1)
+	{
+		if(y1 < y0) { int t = y0; y0 = y1; y1 = t; }
+		fillRect(x0, y0, 1, y1 - y0 + 1, val);
+		return;
+	}
+
+	int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+	int dy = y1 > y0 ? y0 - y1 : y1 - y0;
+	int sx = x0 < x1 ? 1 : -1;
+	int sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy;
+	while(1)
+	{
+		if(x0 >= 0 && x0 < width && y0 >= 0 && y0 < height)
+			buffer[y0 * width + x0] = val;
+		if(x0 == x1 && y0 == y1) break;
+		int e2 = 2 * err;
+		if(e2 >= dy) { err += dy; x0 += sx; }
+		if(e2 <= dx) { err += dx; y0 += sy; }
+	}
+}
+
+// draw the outline of a rectangle
+void LedBoard::drawRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t val)
+{
+	if(width == 0 || height == 0) return;
+	fillRect(x, y, width, 1, val);
+	fillRect(x, y + height - 1, width, 1, val);
+	fillRect(x, y + 1, 1, height - 2, val);
+	fillRect(x + width - 1, y + 1, 1, height - 2, val);
+}
+
+// draw a circle around x, y using the midpoint algorithm
+void LedBoard::drawCircle(int x, int y, int radius, uint8_t val, bool filled)
+{
+	int dx = radius;
+	int dy = 0;
+	int err = 1 - radius;
+	while(dx >= dy)
+	{
+		if(filled)
+		{
+			// spans for the four octant pairs
+			fillRect(x - dx, y + dy, 2 * dx + 1, 1, val);
+			fillRect(x - dx, y - dy, 2 * dx + 1, 1, val);
+			fillRect(x - dy, y + dx, 2 * dy + 1, 1, val);
+			fillRect(x - dy, y - dx, 2 * dy + 1, 1, val);
+		}
+		else
+		{
+			setPixelClipped(val, x + dx, y + dy);
+			setPixelClipped(val, x - dx, y + dy);
+			setPixelClipped(val, x + dx, y - dy);
+			setPixelClipped(val, x - dx, y - dy);
+			setPixelClipped(val, x + dy, y + dx);
+			setPixelClipped(val, x - dy, y + dx);
+			setPixelClipped(val, x + dy, y - dx);
+			setPixelClipped(val, x - dy, y - dx);
+		}
+		dy++;
+		if(err < 0)
+		{
+			err += 2 * dy + 1;
+		}
+		else
+		{
+			dx--;
+			err += 2 * (dy - dx) + 1;
 		}
 	}
-	return width * height;
 }
 
 // render a WIDTH * HEIGHT XBM header
@@ -290,14 +773,74 @@ void LedBoard::drawXBM(const uint8_t* data, uint16_t len)
 }
 
 
-// draw the curent framebuffer on the screen
+// switch between single and double buffering
+bool LedBoard::setBufferMode(uint8_t mode)
+{
+	switch(mode)
+	{
+		case BUFFER_SINGLE:
+			buffer = front;
+			break;
+		case BUFFER_DOUBLE:
+		case BUFFER_DOUBLE_COPY:
+			if(buffer_mode == BUFFER_SINGLE)
+			{
+				// start drawing on top of what is currently shown
+				buffer = front == pages ? pages + TOTAL_SIZE : pages;
+				memcpy(buffer, front, TOTAL_SIZE);
+			}
+			break;
+		default:
+			return false;
+	}
+	buffer_mode = mode;
+	return true;
+}
+
+// commit the back buffer and draw it on the screen
+void LedBoard::flip()
+{
+	if(buffer_mode != BUFFER_SINGLE)
+	{
+		uint8_t* committed = buffer;
+		buffer = front;
+		front = committed;
+		if(buffer_mode == BUFFER_DOUBLE_COPY)
+			memcpy(buffer, front, TOTAL_SIZE);
+	}
+	writeBuffer();
+}
+
+
+// draw the curent front buffer on the screen
 void LedBoard::writeBuffer()
 {
 	outputStart();
+	outputSync();
 	for(int i = 0; i < TOTAL_SIZE; i++)
 	{
-		outputWrite(buffer[pixel_map[i]] >> 1);
+		outputWrite(front[pixel_map[i]] >> 1);
 	}
+	outputLatch();
+}
+
+
+// set the brightness of all segments, 0-255
+void LedBoard::setBrightness(uint8_t level)
+{
+	outputWrite(0xa0);
+	outputWrite(level >> 1);
+}
+
+// let all segments fade to a brightness, they step every SEGMENT_FADE_STEP refreshes
+void LedBoard::fadeBrightness(uint8_t level, uint16_t duration_ms)
+{
+	uint32_t steps = ((uint32_t)duration_ms * SEGMENT_REFRESH_HZ / 1000 + SEGMENT_FADE_STEP / 2) / SEGMENT_FADE_STEP;
+	if(steps > SEGMENT_FADE_STEPS_MAX)
+		steps = SEGMENT_FADE_STEPS_MAX;
+	outputWrite(0xa1);
+	outputWrite(level >> 1);
+	outputWrite(steps);
 }
 
 
@@ -316,12 +859,34 @@ void LedBoard::setPixel(uint8_t val, uint8_t x, uint8_t y)
 }
 
 
+// set pixel by signed x/y position, ignores pixels outside the board
+void LedBoard::setPixelClipped(uint8_t val, int x, int y)
+{
+	if(x < 0 || y < 0 || x >= width || y >= height) return;
+	buffer[y * width + x] = val;
+}
+
+
 // send a reset / start byte to the segments
 void LedBoard::outputStart()
 {
 	outputWrite(0x80);
 }
 
+// send a phase sync, all segments restart their refresh at the same moment so
+// neighbouring panels do not flicker out of step. the low bits count the segments
+// it passed, every segment increments them
+void LedBoard::outputSync()
+{
+	outputWrite(0xb0);
+}
+
+// send a latch byte, all segments show the frame they received at the same time
+void LedBoard::outputLatch()
+{
+	outputWrite(0x90);
+}
+
 // actually write the pixel to the serial interface
 void LedBoard::outputWrite(uint8_t val)
 {
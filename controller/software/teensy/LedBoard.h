@@ -3,10 +3,20 @@
 
 #include <stdint.h>
 
+// resampling filters for drawScaledImage
+#define SCALE_NEAREST 0
+#define SCALE_BOX 1
+#define SCALE_BILINEAR 2
+
+// buffer modes for setBufferMode
+#define BUFFER_SINGLE 0
+#define BUFFER_DOUBLE 1
+#define BUFFER_DOUBLE_COPY 2
+
 class LedBoard
 {
 public:
-	LedBoard() {};
+	LedBoard() : buffer(pages), front(pages), buffer_mode(BUFFER_SINGLE) {};
 	~LedBoard() {};
 
 	void init();
@@ -18,23 +28,49 @@ public:
 	uint16_t drawStringNoLen(char*, uint8_t, uint8_t, uint8_t brightness=0xFF, bool absolute=false);
 	uint16_t drawString(char*, uint16_t, uint8_t, uint8_t, uint8_t brightness=0xFF, bool absolute=false);
 	uint16_t drawImage(uint8_t x, uint8_t y, uint16_t width, uint16_t height, uint8_t* data);
+	uint16_t drawScaledImage(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t src_width, uint8_t src_height, uint8_t mode, const uint8_t* data);
 	void drawXBM(const uint8_t*, uint16_t);
 
-	// output the buffer
+	// vector primitives, all clipped to the board
+	void fillRect(int x, int y, int width, int height, uint8_t val);
+	void fillGradient(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t from, uint8_t to, bool vertical);
+	void drawLine(int x0, int y0, int x1, int y1, uint8_t val);
+	void drawRect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t val);
+	void drawCircle(int x, int y, int radius, uint8_t val, bool filled);
+
+	// buffering
+	bool setBufferMode(uint8_t mode);
+	void flip();
+
+	// output the front buffer
 	void writeBuffer();
 
+	// brightness of the whole board, applied by the segments without sending a frame
+	void setBrightness(uint8_t level);
+	void fadeBrightness(uint8_t level, uint16_t duration_ms);
+
 private:
 	static int panel_layout[][2];
 	static int width;
 	static int height;
-	static uint8_t buffer[];
+	static uint8_t pages[];
+	// buffer drawn into, and the committed buffer that is written to the screen
+	// both point to the same page in single buffer mode
+	uint8_t* buffer;
+	uint8_t* front;
+	uint8_t buffer_mode;
 	static uint16_t pixel_map[];
 
 	void outputStart();
+	void outputSync();
+	void outputLatch();
 	void outputWrite(uint8_t);
 	
+	void scaleSpan(int i, uint32_t step, uint8_t src_size, uint8_t mode, uint8_t* start, uint8_t* end, uint8_t* frac);
+
 	void setPixel(uint8_t val, int pos);
 	void setPixel(uint8_t val, uint8_t x, uint8_t y);
+	void setPixelClipped(uint8_t val, int x, int y);
 };
 
 #endif //_IMAGE_GEN_H
\ No newline at end of file
@@ -1 +1 @@
-unsigned char const exptab[] PROGMEM={0,0,1,2,4,6,9,13,16,21,26,32,38,44,52,59,67,76,85,95,106,117,128,140,152,165,179,193,208,223,238,255,};
+unsigned char const exptab[] PROGMEM={0,0,0,0,1,1,2,3,4,5,6,7,9,10,12,14,16,18,20,23,25,28,31,33,37,40,43,46,50,54,57,61,65,69,74,78,83,87,92,97,102,108,113,118,124,130,135,141,148,154,160,167,173,180,187,194,201,208,216,223,231,239,246,255,};
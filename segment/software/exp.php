@@ -3,8 +3,8 @@
 
 $base=2;
 echo "unsigned char const exptab[] PROGMEM={";
-for ($x=0; $x<32; $x++) {
-    echo intval((pow($x,$base)/pow(31,$base))*255).",";
+for ($x=0; $x<64; $x++) {
+    echo intval((pow($x,$base)/pow(63,$base))*255).",";
 }
 echo "};\n";
 ?>
\ No newline at end of file
@@ -76,7 +76,75 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 //Display memory. The main routine can write here to modify the image on the 
 //LED-board. 0 = black = led completely off, 255 = 'white' = led completely on.
-unsigned char dispmem[512];
+//There are two buffers: dispmem is shown, the uart fills backmem and latch()
+//swaps them, so a frame is never shown while it is being received.
+static unsigned char dispbuf[2][512];
+unsigned char *dispmem = dispbuf[0];
+unsigned char *backmem = dispbuf[1];
+
+//Bit-angle modulation. Every row is shown BAM_BITS times, once for every bit of
+//the pixel values, and each time for a period as long as the weight of the bit.
+//The pixels are kept as bit-planes: for every bit and row 4 bytes for the upper
+//half (dispmem 0..255) and 4 bytes for the lower half, bit 0 of byte 0 is x=0.
+//The top BAM_BITS bits of a dispmem value are shown.
+#define BAM_BITS 6
+//Cycles bit 0 is shown, bit n is shown BAM_UNIT << n cycles.
+#define BAM_UNIT 128
+//Shortest time between two planes. The next plane is shifted into the panel
+//while the current one is shown, the planes of the low bits are followed by a
+//dark period until the shift is done.
+//Shifting takes about 700 cycles, more while the uart is receiving.
+#define BAM_SHIFT_CYCLES 1024
+//A refresh takes 8 * (1024 * 4 + 2048 + 4096) cycles, 195Hz at 16MHz.
+
+static unsigned char planes[BAM_BITS][8][8];
+//plane and row being shown, and the row whose planes do_leds converts next
+static unsigned char bamrow, bambit, convrow;
+
+//Global brightness, 0..BRIGHTNESS_MAX. The planes are lit for a part of their
+//period, lit[bit] cycles. Below BAM_MIN_LIT cycles the compare match B would
+//come before the timer interrupt set it, so a plane is lit at least that long.
+#define BRIGHTNESS_MAX 127
+#define BAM_MIN_LIT 64
+static unsigned int lit[BAM_BITS];
+//Brightness times 256 and its change per refresh while fading, set by the timer
+//interrupt. do_leds recalculates lit when the top byte differs from applied.
+static volatile int level = BRIGHTNESS_MAX << 8;
+static int fadestep;
+static unsigned int fadeleft;
+static unsigned char fadetarget, applied = 0xff;
+//Phase sync: the command reaches every segment a byte time later than the one
+//before it, 320 cycles at 500kbaud plus about 64 for the uart interrupt to get
+//to passing the byte on. A segment waits for the segments after it, so all of
+//them start row 0 at the same moment.
+#define SYNC_HOP_CYCLES 384
+static volatile unsigned char syncing;
+
+//A brightness or fade requested by the uart, started by do_leds
+static unsigned char reqlevel, reqsteps;
+static volatile unsigned char requested;
+
+//Shift a plane into the panel. It is shown at the next strobe.
+static void shift_plane(unsigned char *plane)
+{
+    unsigned char i, n, u, l;
+    PORT_STROBE &= ~(1 << STROBE); //disable strobe in advance
+    for(i = 0; i < 4; i++)
+    {
+        u = plane[i];
+        l = plane[i + 4];
+        for(n = 0; n < 8; n++) //for each pixel:
+        {
+            PORT_UDAT &= ~(1 << UDAT);
+            PORT_LDAT &= ~(1 << LDAT); //clear data inputs
+            PORT_CLK &= ~(1 << CLK); //reset clock in advance
+            if(u & 1) PORT_UDAT |= (1 << UDAT); //if pixel should be shown, set output
+            if(l & 1) PORT_LDAT |= (1 << LDAT); //same for the lower 8 rows
+            u >>= 1; l >>= 1;
+            PORT_CLK |= (1 << CLK); //clock in the bits
+        }
+    }
+}
 
 //Initialize led-board-driver
 void initleds(void)
@@ -84,72 +152,182 @@ void initleds(void)
 //Pin direction
     DDRB = (1 << UDAT) | (1 << LDAT);
     DDRC = (1 << CLK) | (1 << A0) | (1 << A1) | (1 << A2) | (1 << STROBE) | (1 << OE);
-//Timer for ledboard row advance interrupt.
-//Any timer can be used for this, as long as its interrupt routine
-//calls the ISR with a speed of at least 13KHz.
-    // TCCR1A = 0;
-    // TCCR1B = 9; //CTC, no prescaler
-    // OCR1A = (F_CPU / (800 * 8));
-    // TIMSK1=2; //OCIE1A int enable
+    PORT_OE |= (1 << OE); //dark until the first plane
+//Timer for the bit-planes. Every compare match A starts the next plane, compare
+//match B ends the planes that are shorter than the time needed to shift.
+    shift_plane(planes[0][0]);
+    bambit = BAM_BITS - 1;
+    bamrow = 7;
+    TCCR1A = 0;
+    TCCR1B = (1 << WGM12) | (1 << CS10); //CTC, no prescaler
+    OCR1A = BAM_SHIFT_CYCLES;
+    TIMSK1 = (1 << OCIE1A) | (1 << OCIE1B);
 }
 
-//Timer interrupts. Sends the next row of pixels to the LCD.
-
-//This routine has grayscale-support: it tries to PWM each pixel
-//to let the mean of the duty-cycle be the value in the dispmem-array.
-//To reduce flickering, the phase of the pwm-signal is inverted every pixel,
-//every row and every frame. so each pixel will flicker out of sync with the
-//pixels above, beneath, left from and right from it. This'll immensely reduce
-//the perception of flickering, so the 'real' framerate can be much lower than
-//the one required for flicker-free b/w images.
-
+//Set the brightness of the whole segment, 0..BRIGHTNESS_MAX
+void brightness(unsigned char value)
+{
+    reqlevel = value;
+    reqsteps = 0;
+    requested = 1;
+}
 
-//GRAYINC will adjust the precision of the routines. If GRAYINC is
-//(1<<n), the precision will be (8-n) bits. The advantage of a lower precision
-//is that the frame rate can be turned down. (1<<3) is the limit for an
-//ATMega88 at 20MHz and gives 5-bit precision.
-#define GRAYINC (1 << 3)
+//Fade to a brightness in steps of FADE_STEP_REFRESHES refreshes
+void fade(unsigned char value, unsigned char steps)
+{
+    reqlevel = value;
+    reqsteps = steps;
+    requested = 1;
+}
 
-void do_leds()
-// ISR(TIMER1_COMPA_vect)
+//Timer interrupts. Shows the plane that was shifted in and shifts the next one.
+//The plane and the compare values are set with interrupts disabled, so a phase
+//sync from the uart never sees them half updated. The shift is done with
+//interrupts enabled so the uart and compare match B are not held up by it, it
+//is done well before the next compare match A.
+ISR(TIMER1_COMPA_vect)
 {
-    static char rowno; //number of the row we're at now
-    static unsigned char *posu,*posd; //position in display memory
-    static unsigned char comp; //compare-value for grayscales
-    char x;
+    unsigned int period, on;
+    unsigned char *next;
 
-    //Send next line    
-    PORT_STROBE &= ~(1 << STROBE); //disable strobe in advance
-    for(x=0; x<32; x++) //for each pixel:
+    if(syncing) //start over, the first plane of row 0 is shown next
     {
-        PORT_UDAT &= ~(1 << UDAT);
-        PORT_LDAT &= ~(1 << LDAT); //clear data inputs
-        PORT_CLK &= ~(1 << CLK); //reset clock in advance
-        if(*posu > comp) PORT_UDAT |= (1<<UDAT); //if pixel should be shown, set output
-        if(*posd > comp) PORT_LDAT |= (1<<LDAT); //same for the lower 8 rows
-        posu++; posd++; //next memory position
-        PORT_CLK |= (1 << CLK); //clock in the bits
-        comp += 128; //invert phase of pwm every pixel
+        syncing = 0;
+        PORT_OE |= (1 << OE);
+        bambit = BAM_BITS - 1;
+        bamrow = 7;
+        OCR1A = BAM_SHIFT_CYCLES - 1;
+        OCR1B = 0xffff;
+        sei();
+        shift_plane(planes[0][0]);
+        return;
     }
-    comp += 128; //invert phase of pwm every row too
 
+    if(++bambit == BAM_BITS) //Row done?
+    {
+        bambit = 0;
+        bamrow = (bamrow + 1) & 7;
+    }
+    period = BAM_UNIT << bambit;
+    if(period < BAM_SHIFT_CYCLES) period = BAM_SHIFT_CYCLES;
+    on = lit[bambit];
+    OCR1A = period - 1;
+    //a compare value past the top is never reached
+    OCR1B = on && on < period ? on : 0xffff;
 
     PORT_OE |= (1 << OE); //disable led output
     PORT_STROBE |= (1 << STROBE); //latch in the led values
     //select correct row
     PORT_A0 &= ~((1 << A0) | (1 << A1) | (1 << A2));
-    if(rowno & 1) PORT_A0 |= (1 << A0);
-    if(rowno & 2) PORT_A1 |= (1 << A1);
-    if(rowno & 4) PORT_A2 |= (1 << A2);
-    PORT_OE &= ~(1 << OE); //enable led output
-    rowno++; //Ok, this row is done.
-    if(rowno > 7) //Frame done?
+    if(bamrow & 1) PORT_A0 |= (1 << A0);
+    if(bamrow & 2) PORT_A1 |= (1 << A1);
+    if(bamrow & 4) PORT_A2 |= (1 << A2);
+    if(on) PORT_OE &= ~(1 << OE); //enable led output
+
+    if(!bambit && !bamrow && fadeleft) //next refresh, fade a step further
     {
-        rowno = 0; //reset row count
-        posu = dispmem;
-        posd = dispmem + 256; //reset memory pos
-        comp += 128 + GRAYINC; //invert phase of pwm and increase
+        level += fadestep;
+        if(!--fadeleft) level = fadetarget << 8;
     }
+
+    if(bambit + 1 < BAM_BITS)
+        next = planes[bambit + 1][bamrow];
+    else
+        next = planes[0][(bamrow + 1) & 7];
+    sei();
+    shift_plane(next);
 }
 
+//End of a short plane.
+ISR(TIMER1_COMPB_vect)
+{
+    PORT_OE |= (1 << OE); //disable led output
+}
 
+//Restart the refresh together with the other segments, hops is the number of
+//segments before this one. Called from the uart interrupt, the panel stays dark
+//until the restart, at most BAM_SHIFT_CYCLES + SYNC_HOPS * SYNC_HOP_CYCLES.
+void phase_sync(unsigned char hops)
+{
+    if(hops > SYNC_HOPS) hops = SYNC_HOPS;
+    PORT_OE |= (1 << OE);
+    TCNT1 = 0;
+    //the timer interrupt may be shifting, it has to be done before it restarts
+    OCR1A = BAM_SHIFT_CYCLES + (SYNC_HOPS - hops) * SYNC_HOP_CYCLES;
+    OCR1B = 0xffff;
+    syncing = 1;
+}
+
+//Show the back buffer. Called from the uart interrupt, the planes are converted
+//from the new buffer starting at the top row.
+void latch(void)
+{
+    unsigned char *p = dispmem;
+    dispmem = backmem;
+    backmem = p;
+    convrow = 0;
+}
+
+//Converts the next row of dispmem into bit-planes, called from the main loop.
+//The display itself runs from the timer, the time this takes does not matter.
+void do_leds()
+{
+    unsigned char i, n, b, v;
+    unsigned char up[BAM_BITS], lo[BAM_BITS];
+    unsigned char *posu = dispmem + convrow * 32, *posd = posu + 256;
+    unsigned long t;
+    int step;
+
+    if(requested) //start a brightness change
+    {
+        requested = 0;
+        v = reqlevel > BRIGHTNESS_MAX ? BRIGHTNESS_MAX : reqlevel;
+        n = reqsteps;
+        step = n ? (((int)v << 8) - level) / ((int)n * FADE_STEP_REFRESHES) : 0;
+        cli();
+        fadeleft = 0;
+        if(n)
+        {
+            fadetarget = v;
+            fadestep = step;
+            fadeleft = n * FADE_STEP_REFRESHES;
+        }
+        else level = v << 8;
+        sei();
+    }
+    cli();
+    v = level >> 8;
+    sei();
+    if(v != applied) //brightness changed, recalculate the lit times
+    {
+        applied = v;
+        for(b = 0; b < BAM_BITS; b++)
+        {
+            t = ((unsigned long)BAM_UNIT << b) * v / BRIGHTNESS_MAX;
+            if(t && t < BAM_MIN_LIT) t = BAM_MIN_LIT;
+            cli();
+            lit[b] = t;
+            sei();
+        }
+    }
+
+    for(i = 0; i < 4; i++)
+    {
+        for(b = 0; b < BAM_BITS; b++) up[b] = lo[b] = 0;
+        for(n = 0; n < 8; n++)
+        {
+            v = *posu++ >> (8 - BAM_BITS);
+            for(b = 0; b < BAM_BITS; b++)
+                if(v & (1 << b)) up[b] |= 1 << n;
+            v = *posd++ >> (8 - BAM_BITS);
+            for(b = 0; b < BAM_BITS; b++)
+                if(v & (1 << b)) lo[b] |= 1 << n;
+        }
+        for(b = 0; b < BAM_BITS; b++)
+        {
+            planes[b][convrow][i] = up[b];
+            planes[b][convrow][i + 4] = lo[b];
+        }
+    }
+    convrow = (convrow + 1) & 7;
+}
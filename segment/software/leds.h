@@ -1,5 +1,18 @@
 #define F_CPU 16000000
 
-extern unsigned char dispmem[];
+extern unsigned char *dispmem;
+extern unsigned char *backmem;
 void initleds(void);
-void do_leds(void);
\ No newline at end of file
+void do_leds(void);
+void latch(void);
+
+//Brightness of the whole segment, 0..127. The length of a fade is given in steps
+//of 16 refreshes, the brightness changes a little every refresh.
+#define FADE_STEP_REFRESHES 16
+void brightness(unsigned char value);
+void fade(unsigned char value, unsigned char steps);
+
+//Restart the refresh at row 0 on all segments at once. SYNC_HOPS is the longest
+//chain that is kept in phase, the board has 9 segments.
+#define SYNC_HOPS 9
+void phase_sync(unsigned char hops);
\ No newline at end of file
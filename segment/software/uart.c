@@ -2,6 +2,7 @@
 #include <avr/interrupt.h>
 #include "exp.h"
 #include "leds.h"
+#include "uart.h"
 
 
 void uart_setup(void)
@@ -29,17 +30,42 @@ ISR(USART_RX_vect)
 {
     static short wpos=0;
     static unsigned char *wptr;
+    static unsigned char latching=0; //the controller sends CMD_LATCH
+    static unsigned char ready=0; //a whole frame is waiting for CMD_LATCH
+    static unsigned char cmd=0, nparam=0, param[2]; //command waiting for parameters
     unsigned char b;
     b = UDR0;
     //Pass through all command bytes
     if(b & 0x80)
     {
+        cmd=0;
+        if((b & ~CMD_SYNC_HOPS) == CMD_SYNC) //one segment further
+        {
+            UDR0=(b & CMD_SYNC_HOPS) < CMD_SYNC_HOPS ? b + 1 : b;
+            phase_sync(b & CMD_SYNC_HOPS);
+            return;
+        }
 //      while((UCSR0A&(1<<5))==0) ;
         UDR0=b;
-        if(b == 0x80) //reset frame
+        if(b == CMD_RESET) //reset frame
         {
             wpos=0;
-            wptr=dispmem;
+            wptr=backmem;
+            ready=0;
+        }
+        else if(b == CMD_LATCH) //show the frame
+        {
+            latching=1;
+            if(ready)
+            {
+                ready=0;
+                latch();
+            }
+        }
+        else if(b == CMD_BRIGHTNESS || b == CMD_FADE)
+        {
+            cmd=b;
+            nparam=0;
         } /*
         else if (b==0xaa) //reset avr
         {
@@ -51,7 +77,24 @@ ISR(USART_RX_vect)
         } */
         return;
     }
-    
+
+    if(cmd) //parameter of a command, passed on too
+    {
+        UDR0=b;
+        param[nparam++]=b;
+        if(cmd == CMD_BRIGHTNESS)
+        {
+            brightness(param[0]);
+            cmd=0;
+        }
+        else if(nparam == 2)
+        {
+            fade(param[0], param[1]);
+            cmd=0;
+        }
+        return;
+    }
+
     if(wpos == 512) //check display full
     {
         //yes -> pass through
@@ -60,10 +103,15 @@ ISR(USART_RX_vect)
     }
     else
     {
-//      dispmem[wpos++]=pgm_read_byte(exptab+(b>>2));
-        *wptr=pgm_read_byte(exptab+(b>>2));
+//      dispmem[wpos++]=pgm_read_byte(exptab+(b>>1));
+        *wptr=pgm_read_byte(exptab+(b>>1));
         wptr++;
         wpos++;
+        if(wpos == 512)
+        {
+            if(latching) ready=1;
+            else latch(); //no latch coming, show it now
+        }
     }
 }
 
@@ -1 +1,17 @@
 void uart_setup(void);
+
+//Command bytes, passed on to the next segment.
+//Start of a frame, the next 512 data bytes are for this segment.
+#define CMD_RESET 0x80
+//Show the frame that was received. Until the first latch a frame is shown as
+//soon as it is complete, for controllers that do not send it.
+#define CMD_LATCH 0x90
+//Restart the refresh, the low bits are the number of segments before this one.
+//The controller sends CMD_SYNC, every segment passes it on incremented. Older
+//segments pass it on unchanged and ignore it.
+#define CMD_SYNC 0xb0
+#define CMD_SYNC_HOPS 0x0f
+//Set the brightness, followed by the level 0..127.
+#define CMD_BRIGHTNESS 0xa0
+//Fade, followed by the level and the number of steps of FADE_STEP_REFRESHES.
+#define CMD_FADE 0xa1
@@ -0,0 +1,67 @@
+#ifndef _SHIM_ARDUINO_H_
+#define _SHIM_ARDUINO_H_
+
+// host replacement for <Arduino.h>, as far as the EtherCard sources use it, see shim.h
+#include "shim.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+// arduino uno pins
+#define SS 10
+#define MOSI 11
+#define MISO 12
+#define SCK 13
+
+#define bit(b) (1UL << (b))
+#define bitRead(value, b) (((value) >> (b)) & 0x01)
+#define bitSet(value, b) ((value) |= (1UL << (b)))
+#define bitClear(value, b) ((value) &= ~(1UL << (b)))
+
+// SPI registers, SPSR always says the transfer is done
+#define SPE 6
+#define MSTR 4
+#define SPIF 7
+#define SPI2X 0
+extern uint8_t SPCR;
+extern uint8_t SPSR;
+extern ShimSpiData SPDR;
+
+// interrupts do not exist on the host
+#define cli()
+#define sei()
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+unsigned long millis();
+void delay(unsigned long ms);
+
+// avr-libc has it in <stdlib.h>
+static inline char* ltoa(long value, char* s, int radix)
+{
+	sprintf(s, radix == 16 ? "%lx" : "%ld", value);
+	return s;
+}
+
+class __FlashStringHelper;
+
+// only what BufferFiller and Stash use
+class Print
+{
+public:
+	virtual size_t write(uint8_t value) { return 0; }
+};
+
+#endif //_SHIM_ARDUINO_H_
@@ -0,0 +1,10 @@
+#ifndef _SHIM_AVR_EEPROM_H_
+#define _SHIM_AVR_EEPROM_H_
+
+// host replacement for <avr/eeprom.h>, the EtherCard formatting code can read strings from
+// eeprom, on the host they are ordinary memory like flash
+#include <stdint.h>
+
+#define eeprom_read_byte(address) (*(const uint8_t*)(address))
+
+#endif //_SHIM_AVR_EEPROM_H_
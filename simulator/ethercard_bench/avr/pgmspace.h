@@ -0,0 +1,16 @@
+#ifndef _SHIM_AVR_PGMSPACE_H_
+#define _SHIM_AVR_PGMSPACE_H_
+
+// host replacement for <avr/pgmspace.h>, flash is ordinary memory
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const unsigned char*)(address))
+#define pgm_read_word(address) (*(const unsigned short*)(address))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+
+#endif //_SHIM_AVR_PGMSPACE_H_
@@ -0,0 +1,570 @@
+// replays a packet capture into the EtherCard stack through the ENC28J60 model
+//
+// EtherCard.cpp, tcpip.cpp, udpserver.cpp and enc28j60.cpp are built for the host unchanged,
+// with the chip behind them modelled at the SPI level (shim.h). frames from the capture go
+// into the chip's receive ring as fast as it takes them, packetLoop(packetReceive()) empties
+// it like loop() in ledboard.ino. the udp 1337 handler does what the one in ledboard.ino
+// does, through TxExpander into TxRing, with the usart taking the bytes out at once.
+//
+// what the capture should do to the controller is worked out from the frames themselves:
+// the datagrams for udp 1337, the arp and ping requests that need a reply. the datagrams
+// that reached the handler and the replies that were sent are checked against that.
+//
+//	./ethercard_bench -g sample.pcap			write a capture with arp, ping and udp 1337 bursts
+//	./ethercard_bench [-a ip] [-r repeats] capture.pcap
+
+#include "EtherCard.h"
+#include "TxRing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// as in ledboard.ino
+#define SIZE (96 * 48)
+static byte mymac[] = { 0x70, 0x69, 0x69, 0xCA, 0xFE, 0x00 };
+static byte default_ip[4] = { 10, 42, 3, 12 };
+static byte default_gateway[4] = { 10, 42, 1, 1 };
+static byte default_netmask[4] = { 255, 255, 0, 0 };
+byte Ethernet::buffer[1536];
+
+// MAX_FRAMELEN in enc28j60.cpp, the MAC drops longer frames (with their crc)
+#define MAX_FRAMELEN 1500
+// the datagram size ledsend.py uses
+#define BURST_DATAGRAM 1400
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_FILE_HEADER 24
+#define PCAP_RECORD_HEADER 16
+
+struct Frame
+{
+	const uint8_t* data;
+	uint16_t len;
+};
+
+// what the controller does with the capture, counted from the frames and from the stack
+struct Traffic
+{
+	uint64_t datagrams;
+	uint64_t bytes;
+	uint32_t hash;
+	uint64_t arp;
+	uint64_t icmp;
+};
+
+static byte myip[4];
+static Frame* frames;
+static int frame_count;
+
+static Traffic expected;
+static Traffic received;
+static uint64_t other_sent;
+static uint64_t bad_checksums;
+static uint64_t cut_datagrams;
+
+static TxRing tx_ring;
+static TxExpander tx_expander;
+static uint64_t serial_bytes;
+
+static uint16_t get16(const uint8_t* p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t hashBytes(uint32_t hash, const uint8_t* data, uint16_t len)
+{
+	for(uint16_t i = 0; i < len; i++)
+		hash = (hash ^ data[i]) * 16777619;
+	return hash;
+}
+
+static uint16_t checksum(const uint8_t* data, uint16_t len)
+{
+	uint32_t sum = 0;
+	for(uint16_t i = 0; i + 1 < len; i += 2)
+		sum += get16(data + i);
+	if(len & 1)
+		sum += data[len - 1] << 8;
+	while(sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+// the usart interrupt in ledboard.ino takes a byte out when the ring is full
+static void serialWrite(byte val)
+{
+	byte sent;
+	while(!tx_ring.put(val))
+	{
+		tx_ring.get(&sent);
+		serial_bytes++;
+	}
+}
+
+// the 1337 case of udpReceive in ledboard.ino
+static void udpReceive(uint16_t port, uint8_t ip[4], const char* chr_data, uint16_t len)
+{
+	const byte* data = (const byte*)chr_data;
+	// the length comes from the udp header, the frame in the buffer may be shorter
+	if(data + len > Ethernet::buffer + sizeof(Ethernet::buffer))
+	{
+		cut_datagrams++;
+		len = Ethernet::buffer + sizeof(Ethernet::buffer) - data;
+	}
+	received.datagrams++;
+	received.bytes += len;
+	received.hash = hashBytes(received.hash, data, len);
+
+	byte pixels_per_byte = tx_expander.pixelsPerByte();
+	if(pixels_per_byte != 1 && pixels_per_byte != 7)
+	{
+		serialWrite(0x80);
+		for(int i = 0; i < pixels_per_byte; i++)
+			serialWrite(0x7f);
+		return;
+	}
+	byte out[7];
+	for(int i = 0; i < len; i++)
+	{
+		byte count = tx_expander.expand(*data++, out);
+		for(byte j = 0; j < count; j++)
+			serialWrite(out[j]);
+	}
+}
+
+// frames the stack sends: arp and ping replies, and its own arp requests for the gateway
+static void transmitted(void* ctx, const uint8_t* frame, uint16_t len)
+{
+	uint16_t type = get16(frame + 12);
+	if(type == 0x0806 && len >= 42 && get16(frame + 20) == 2)
+	{
+		received.arp++;
+		return;
+	}
+	if(type == 0x0800 && len >= 42 && frame[23] == 1 && frame[34] == 0)
+	{
+		uint16_t ip_len = get16(frame + 16);
+		if(checksum(frame + 14, 20) != 0 || ip_len > len - 14 || checksum(frame + 34, ip_len - 20) != 0)
+			bad_checksums++;
+		received.icmp++;
+		return;
+	}
+	other_sent++;
+}
+
+// what the stack should do with a frame, the MAC filter and tcpip.cpp's rules written out
+static void expect(const uint8_t* frame, uint16_t len)
+{
+	if(len < 14 || (len < 60 ? 60 : len) + 4 > MAX_FRAMELEN)
+		return;
+	bool broadcast = memcmp(frame, "\xff\xff\xff\xff\xff\xff", 6) == 0;
+	if(!broadcast && memcmp(frame, mymac, 6) != 0)
+		return;
+
+	uint16_t type = get16(frame + 12);
+	if(type == 0x0806)
+	{
+		if(len >= 42 && get16(frame + 20) == 1 && memcmp(frame + 38, myip, 4) == 0)
+			expected.arp++;
+		return;
+	}
+	if(type != 0x0800 || len < 34 || frame[14] != 0x45)
+		return;
+	byte subnet_broadcast[4];
+	for(int i = 0; i < 4; i++)
+		subnet_broadcast[i] = myip[i] | ~default_netmask[i];
+	const uint8_t* dst = frame + 30;
+	if(memcmp(dst, myip, 4) != 0 && memcmp(dst, subnet_broadcast, 4) != 0 && memcmp(dst, "\xff\xff\xff\xff", 4) != 0)
+		return;
+	if(frame[23] == 1 && len >= 35 && frame[34] == 8)
+		expected.icmp++;
+	else if(frame[23] == 17 && len >= 42 && get16(frame + 36) == 1337)
+	{
+		uint16_t datalen = get16(frame + 38) - 8;
+		if(42 + datalen > len)
+			return;
+		expected.datagrams++;
+		expected.bytes += datalen;
+		expected.hash = hashBytes(expected.hash, frame + 42, datalen);
+	}
+}
+
+static uint32_t read32(const uint8_t* p, bool swap)
+{
+	uint32_t value;
+	memcpy(&value, p, 4);
+	return swap ? __builtin_bswap32(value) : value;
+}
+
+// the whole file stays in memory, frames point into it
+static bool loadCapture(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(!file)
+	{
+		printf("Cannot open %s\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	uint8_t* data = (uint8_t*)malloc(size);
+	if(fread(data, 1, size, file) != (size_t)size || size < PCAP_FILE_HEADER)
+	{
+		printf("Cannot read %s\n", path);
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+
+	uint32_t magic = read32(data, false);
+	bool swap = magic == __builtin_bswap32(PCAP_MAGIC) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+	if(!swap && magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS)
+	{
+		printf("%s is not a pcap file (pcapng is not read, convert it with editcap -F pcap)\n", path);
+		return false;
+	}
+	if(read32(data + 20, swap) != PCAP_LINKTYPE_ETHERNET)
+	{
+		printf("%s is not an ethernet capture\n", path);
+		return false;
+	}
+
+	int capacity = 1024;
+	int cut = 0;
+	frames = (Frame*)malloc(capacity * sizeof(Frame));
+	frame_count = 0;
+	for(long pos = PCAP_FILE_HEADER; pos + PCAP_RECORD_HEADER <= size;)
+	{
+		uint32_t caplen = read32(data + pos + 8, swap);
+		uint32_t len = read32(data + pos + 12, swap);
+		pos += PCAP_RECORD_HEADER;
+		if(pos + caplen > (unsigned long)size)
+			break;
+		// frames cut short by the snapshot length are not what was on the wire
+		if(caplen != len || len > 0xffff)
+			cut++;
+		else
+		{
+			if(frame_count == capacity)
+			{
+				capacity *= 2;
+				frames = (Frame*)realloc(frames, capacity * sizeof(Frame));
+			}
+			frames[frame_count].data = data + pos;
+			frames[frame_count].len = len;
+			frame_count++;
+		}
+		pos += caplen;
+	}
+	if(cut)
+		printf("%d frames were cut short in the capture and are left out\n", cut);
+	return true;
+}
+
+// sample capture
+
+static FILE* sample;
+static uint32_t sample_us;
+
+static void sampleWrite(const uint8_t* frame, uint16_t len, uint32_t gap_us)
+{
+	sample_us += gap_us;
+	uint32_t header[4] = { sample_us / 1000000, sample_us % 1000000, len, len };
+	fwrite(header, 4, 4, sample);
+	fwrite(frame, 1, len, sample);
+}
+
+static void sampleEthernet(uint8_t* frame, const uint8_t* dst, const uint8_t* src, uint16_t type)
+{
+	memcpy(frame, dst, 6);
+	memcpy(frame + 6, src, 6);
+	frame[12] = type >> 8;
+	frame[13] = type;
+}
+
+static void sampleArp(const uint8_t* mac, const uint8_t* ip, const uint8_t* target)
+{
+	uint8_t frame[42];
+	sampleEthernet(frame, (const uint8_t*)"\xff\xff\xff\xff\xff\xff", mac, 0x0806);
+	memcpy(frame + 14, "\x00\x01\x08\x00\x06\x04\x00\x01", 8);
+	memcpy(frame + 22, mac, 6);
+	memcpy(frame + 28, ip, 4);
+	memset(frame + 32, 0, 6);
+	memcpy(frame + 38, target, 4);
+	sampleWrite(frame, sizeof(frame), 2000);
+}
+
+// ip header and the protocol header, udp without a checksum
+static void sampleIp(uint8_t* frame, const uint8_t* dst_mac, const uint8_t* src_mac, const uint8_t* src, const uint8_t* dst, uint8_t protocol, uint16_t len)
+{
+	static uint16_t id;
+	sampleEthernet(frame, dst_mac, src_mac, 0x0800);
+	uint8_t* ip = frame + 14;
+	memset(ip, 0, 20);
+	ip[0] = 0x45;
+	ip[2] = (20 + len) >> 8;
+	ip[3] = 20 + len;
+	ip[4] = ++id >> 8;
+	ip[5] = id;
+	ip[6] = 0x40;
+	ip[8] = 64;
+	ip[9] = protocol;
+	memcpy(ip + 12, src, 4);
+	memcpy(ip + 16, dst, 4);
+	uint16_t sum = checksum(ip, 20);
+	ip[10] = sum >> 8;
+	ip[11] = sum;
+}
+
+static void sampleUdp(const uint8_t* dst_mac, const uint8_t* src_mac, const uint8_t* src, const uint8_t* dst, uint16_t port, const uint8_t* data, uint16_t len, uint32_t gap_us)
+{
+	static uint8_t frame[1514];
+	sampleIp(frame, dst_mac, src_mac, src, dst, 17, 8 + len);
+	uint8_t* udp = frame + 34;
+	udp[0] = 0xc0;
+	udp[1] = 0x00;
+	udp[2] = port >> 8;
+	udp[3] = port;
+	udp[4] = (8 + len) >> 8;
+	udp[5] = 8 + len;
+	udp[6] = 0;
+	udp[7] = 0;
+	memcpy(udp + 8, data, len);
+	sampleWrite(frame, 42 + len, gap_us);
+}
+
+static void samplePing(const uint8_t* mac, const uint8_t* src, uint16_t seq)
+{
+	uint8_t frame[98];
+	sampleIp(frame, mymac, mac, src, myip, 1, 64);
+	uint8_t* icmp = frame + 34;
+	memset(icmp, 0, 64);
+	icmp[0] = 8;
+	icmp[6] = seq >> 8;
+	icmp[7] = seq;
+	for(int i = 8; i < 64; i++)
+		icmp[i] = i;
+	uint16_t sum = checksum(icmp, 64);
+	icmp[2] = sum >> 8;
+	icmp[3] = sum;
+	sampleWrite(frame, sizeof(frame), 3000);
+}
+
+// a picture as ledsend.py sends it, 7 pixels per byte or one pixel per byte in 1400 byte
+// datagrams, with arp, ping and traffic for other hosts in between
+static bool writeSample(const char* path)
+{
+	sample = fopen(path, "wb");
+	if(!sample)
+	{
+		printf("Cannot write %s\n", path);
+		return false;
+	}
+	uint32_t header[6] = { PCAP_MAGIC, 0x00040002, 0, 0, 65535, PCAP_LINKTYPE_ETHERNET };
+	fwrite(header, 4, 6, sample);
+
+	const uint8_t sender_mac[6] = { 0x02, 0x00, 0x0a, 0x2a, 0x02, 0x68 };
+	const uint8_t sender_ip[4] = { 10, 42, 2, 104 };
+	const uint8_t other_mac[6] = { 0x02, 0x00, 0x0a, 0x2a, 0x01, 0x14 };
+	const uint8_t other_ip[4] = { 10, 42, 1, 20 };
+	const uint8_t mdns_mac[6] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0xfb };
+	const uint8_t mdns_ip[4] = { 224, 0, 0, 251 };
+	const uint8_t broadcast_mac[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	const uint8_t broadcast_ip[4] = { 10, 42, 255, 255 };
+	static uint8_t data[SIZE + 2];
+	uint8_t small[64];
+	memset(small, 0x55, sizeof(small));
+
+	sampleArp(sender_mac, sender_ip, myip);
+	sampleArp(other_mac, other_ip, default_gateway);
+	for(int picture = 0; picture < 50; picture++)
+	{
+		int len = 0;
+		data[len++] = 0x80;
+		if(picture & 1)
+		{
+			for(int i = 0; i < SIZE; i++)
+				data[len++] = ((i % 96) / 4 + picture) & 0x7f;
+		}
+		else
+		{
+			data[len++] = 0x87;
+			for(int i = 0; i < SIZE / 7 + 1; i++)
+				data[len++] = ((i + picture) * 37) & 0x7f;
+		}
+		data[len++] = 0x90;
+		for(int pos = 0; pos < len; pos += BURST_DATAGRAM)
+		{
+			int part = len - pos < BURST_DATAGRAM ? len - pos : BURST_DATAGRAM;
+			sampleUdp(mymac, sender_mac, sender_ip, myip, 1337, data + pos, part, pos ? 1200 : 40000);
+		}
+
+		if(picture % 10 == 0)
+		{
+			samplePing(sender_mac, sender_ip, picture / 10);
+			sampleArp(sender_mac, sender_ip, myip);
+		}
+		if(picture % 5 == 0)
+		{
+			sampleUdp(other_mac, sender_mac, sender_ip, other_ip, 1337, small, sizeof(small), 500);
+			sampleUdp(broadcast_mac, other_mac, other_ip, broadcast_ip, 138, small, sizeof(small), 500);
+			sampleUdp(mdns_mac, other_mac, other_ip, mdns_ip, 5353, small, sizeof(small), 500);
+		}
+		// a datagram as long as an ethernet frame allows, longer than the driver lets in
+		if(picture % 25 == 0)
+			sampleUdp(mymac, sender_mac, sender_ip, myip, 1337, data, 1472, 500);
+	}
+	fclose(sample);
+	printf("Wrote %s\n", path);
+	return true;
+}
+
+static uint64_t nanoseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// packets handled, and the time and SPI traffic it took
+static uint64_t packets;
+static uint64_t loop_ns;
+static uint64_t spi_bytes;
+static uint64_t spi_transactions;
+
+// loop() in ledboard.ino until the receive ring is empty
+static void service()
+{
+	uint64_t bytes = shim_enc.spi_bytes;
+	uint64_t transactions = shim_enc.spi_transactions;
+	uint8_t pending = shim_enc.pending();
+	uint64_t start = nanoseconds();
+	while(shim_enc.pending())
+		ether.packetLoop(ether.packetReceive());
+	loop_ns += nanoseconds() - start;
+	packets += pending;
+	spi_bytes += shim_enc.spi_bytes - bytes;
+	spi_transactions += shim_enc.spi_transactions - transactions;
+}
+
+static void usage()
+{
+	printf("Usage: ethercard_bench [-a ip] [-r repeats] capture.pcap\n");
+	printf("       ethercard_bench -g sample.pcap\n");
+}
+
+int main(int argc, char* argv[])
+{
+	const char* generate = 0;
+	int repeats = 100;
+	memcpy(myip, default_ip, 4);
+
+	int opt;
+	while((opt = getopt(argc, argv, "a:r:g:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'a':
+				if(sscanf(optarg, "%hhu.%hhu.%hhu.%hhu", &myip[0], &myip[1], &myip[2], &myip[3]) != 4)
+				{
+					usage();
+					return 1;
+				}
+				break;
+			case 'r':
+				repeats = atoi(optarg);
+				break;
+			case 'g':
+				generate = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if(generate)
+		return writeSample(generate) ? 0 : 1;
+	if(optind != argc - 1 || repeats < 1)
+	{
+		usage();
+		return 1;
+	}
+	if(!loadCapture(argv[optind]))
+		return 1;
+
+	shim_enc.transmit = transmitted;
+	if(ether.begin(sizeof Ethernet::buffer, mymac, SHIM_SELECT_PIN) == 0)
+	{
+		printf("Failed to access the ENC28J60 model\n");
+		return 1;
+	}
+	ether.staticSetup(myip, default_gateway, 0, default_netmask);
+	ether.udpServerListenOnPort(&udpReceive, 1337);
+	expected.hash = received.hash = 2166136261u;
+
+	// the ring is emptied whenever the next frame does not fit, and at the end of the capture
+	for(int repeat = 0; repeat < repeats; repeat++)
+	{
+		for(int i = 0; i < frame_count; i++)
+		{
+			if(!shim_enc.room(frames[i].len))
+				service();
+			expect(frames[i].data, frames[i].len);
+			shim_enc.receive(frames[i].data, frames[i].len);
+		}
+		service();
+	}
+	// the idle call, where the stack asks for the gateway
+	ether.packetLoop(ether.packetReceive());
+	byte sent;
+	while(tx_ring.get(&sent))
+		serial_bytes++;
+
+	EncDrops* drops = &shim_enc.drops;
+	printf("%s: %d frames, %d times\n", argv[optind], frame_count, repeats);
+	printf("ENC28J60 took %llu, dropped %llu not for this controller and %llu longer than %d bytes\n",
+		(unsigned long long)packets, (unsigned long long)drops->filter, (unsigned long long)drops->too_long, MAX_FRAMELEN);
+	if(packets)
+	{
+		printf("packetLoop: %.0f packets/s, %.0f ns per packet\n", packets * 1e9 / loop_ns, (double)loop_ns / packets);
+		// a byte takes 1 us at 8MHz, the loop around SPDR and the chip selects come on top
+		printf("SPI: %.1f bytes in %.1f transactions per packet, at least %.0f us per packet at 8MHz\n",
+			(double)spi_bytes / packets, (double)spi_transactions / packets, (double)spi_bytes / packets);
+	}
+	printf("udp 1337: %llu datagrams, %llu bytes, %llu bytes to the segments\n",
+		(unsigned long long)received.datagrams, (unsigned long long)received.bytes, (unsigned long long)serial_bytes);
+	printf("replies: %llu arp, %llu ping, %llu other frames sent\n",
+		(unsigned long long)received.arp, (unsigned long long)received.icmp, (unsigned long long)other_sent);
+
+	bool ok = true;
+	if(received.datagrams != expected.datagrams || received.bytes != expected.bytes || received.hash != expected.hash)
+	{
+		printf("FAIL: the capture has %llu datagrams with %llu bytes for udp 1337, the handler got %s\n",
+			(unsigned long long)expected.datagrams, (unsigned long long)expected.bytes,
+			received.datagrams == expected.datagrams && received.bytes == expected.bytes ? "other data" : "something else");
+		ok = false;
+	}
+	if(cut_datagrams)
+	{
+		printf("FAIL: %llu datagrams were longer than their frame\n", (unsigned long long)cut_datagrams);
+		ok = false;
+	}
+	if(received.arp != expected.arp || received.icmp != expected.icmp)
+	{
+		printf("FAIL: the capture asks for %llu arp and %llu ping replies\n", (unsigned long long)expected.arp, (unsigned long long)expected.icmp);
+		ok = false;
+	}
+	if(bad_checksums)
+	{
+		printf("FAIL: %llu ping replies with a bad checksum\n", (unsigned long long)bad_checksums);
+		ok = false;
+	}
+	if(ok)
+		printf("OK: every datagram and reply the capture asks for\n");
+	return ok ? 0 : 1;
+}
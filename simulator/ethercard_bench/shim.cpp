@@ -0,0 +1,357 @@
+// the ENC28J60 model and the arduino functions enc28j60.cpp calls, see shim.h
+//
+// register addresses and bits are those of the datasheet (DS39662), the same numbers as the
+// defines in enc28j60.cpp. only what the driver uses is modelled: no dma, no self test, no
+// pattern or hash table filters, the link is always up and a transmit never fails.
+
+#include "Arduino.h"
+#include <time.h>
+
+// SPI opcodes, the upper 3 bits of the first byte
+#define OP_READ_CTRL_REG 0x00
+#define OP_READ_BUF_MEM 0x20
+#define OP_WRITE_CTRL_REG 0x40
+#define OP_WRITE_BUF_MEM 0x60
+#define OP_BIT_FIELD_SET 0x80
+#define OP_BIT_FIELD_CLR 0xa0
+#define OP_SOFT_RESET 0xff
+
+// registers in every bank
+#define R_EIR 0x1c
+#define R_ESTAT 0x1d
+#define R_ECON2 0x1e
+#define R_ECON1 0x1f
+// bank 0, 16 bit registers low byte first
+#define R_ERDPT 0x00
+#define R_EWRPT 0x02
+#define R_ETXST 0x04
+#define R_ETXND 0x06
+#define R_ERXST 0x08
+#define R_ERXND 0x0a
+#define R_ERXRDPT 0x0c
+// bank 1
+#define R_ERXFCON 0x18
+#define R_EPKTCNT 0x19
+// bank 2
+#define R_MACON3 0x02
+#define R_MAMXFL 0x0a
+#define R_MICMD 0x12
+#define R_MIREGADR 0x14
+#define R_MIWR 0x16
+#define R_MIRD 0x18
+// bank 3
+#define R_EREVID 0x12
+
+#define EIR_TXIF 0x08
+#define ESTAT_CLKRDY 0x01
+#define ECON2_AUTOINC 0x80
+#define ECON2_PKTDEC 0x40
+#define ECON1_TXRTS 0x08
+#define ECON1_RXEN 0x04
+#define ECON1_BSEL 0x03
+#define ERXFCON_UCEN 0x80
+#define ERXFCON_MCEN 0x02
+#define ERXFCON_BCEN 0x01
+#define MACON3_HFRMEN 0x04
+#define MICMD_MIIRD 0x01
+
+#define PHY_PHID1 0x02
+#define PHY_PHID2 0x03
+#define PHY_PHSTAT2 0x11
+#define PHSTAT2_LSTAT 0x0400
+
+// rev B7 reports 6
+#define ENC_REVISION 6
+// the sender pads frames to 60 bytes, 64 with the crc
+#define ETH_MIN_FRAME 60
+// next packet pointer, byte count, status
+#define RX_HEADER_SIZE 6
+#define RX_STATUS_OK 0x0080
+#define RX_STATUS_MULTICAST 0x0100
+#define RX_STATUS_BROADCAST 0x0200
+
+Enc28j60Model shim_enc;
+
+// power on and soft reset values of the registers the driver relies on
+void Enc28j60Model::reset()
+{
+	memset(bank, 0, sizeof(bank));
+	memset(phy, 0, sizeof(phy));
+	bank[0][R_ESTAT] = ESTAT_CLKRDY;
+	bank[0][R_ECON2] = ECON2_AUTOINC;
+	setReg16(0, R_ERDPT, 0x05fa);
+	setReg16(0, R_ERXST, 0x05fa);
+	setReg16(0, R_ERXND, 0x1fff);
+	setReg16(0, R_ERXRDPT, 0x05fa);
+	bank[1][R_ERXFCON] = ERXFCON_UCEN | 0x20 | ERXFCON_BCEN;
+	setReg16(2, R_MAMXFL, 1518);
+	bank[3][R_EREVID] = ENC_REVISION;
+	phy[PHY_PHID1] = 0x0083;
+	phy[PHY_PHID2] = 0x1400;
+	phy[PHY_PHSTAT2] = PHSTAT2_LSTAT;
+	rx_write = reg16(0, R_ERXST);
+	selected = false;
+	have_opcode = false;
+	memset(&drops, 0, sizeof(drops));
+}
+
+void Enc28j60Model::select(bool low)
+{
+	if(low && !selected)
+	{
+		spi_transactions++;
+		have_opcode = false;
+	}
+	selected = low;
+}
+
+uint8_t Enc28j60Model::transfer(uint8_t value)
+{
+	spi_bytes++;
+	if(!selected)
+		return 0xff;
+	if(!have_opcode)
+	{
+		have_opcode = true;
+		opcode = value & 0xe0;
+		address = value & 0x1f;
+		if(value == OP_SOFT_RESET)
+			reset();
+		return 0;
+	}
+	switch(opcode)
+	{
+		// a MAC or MII register is read with a dummy byte first, both bytes give the value
+		case OP_READ_CTRL_REG:
+			return *reg(address);
+		case OP_READ_BUF_MEM:
+		{
+			uint16_t pointer = reg16(0, R_ERDPT);
+			uint8_t result = memory[pointer];
+			if(bank[0][R_ECON2] & ECON2_AUTOINC)
+			{
+				// reading wraps at the end of the receive ring, like writing does
+				if(pointer == reg16(0, R_ERXND))
+					pointer = reg16(0, R_ERXST);
+				else
+					pointer = (pointer + 1) & (ENC_MEMORY_SIZE - 1);
+				setReg16(0, R_ERDPT, pointer);
+			}
+			return result;
+		}
+		case OP_WRITE_CTRL_REG:
+			writeReg(address, value);
+			break;
+		case OP_WRITE_BUF_MEM:
+		{
+			uint16_t pointer = reg16(0, R_EWRPT);
+			memoryWrite(&pointer, value);
+			setReg16(0, R_EWRPT, pointer);
+			break;
+		}
+		case OP_BIT_FIELD_SET:
+			writeReg(address, *reg(address) | value);
+			break;
+		case OP_BIT_FIELD_CLR:
+			writeReg(address, *reg(address) & ~value);
+			break;
+	}
+	return 0;
+}
+
+bool Enc28j60Model::receive(const uint8_t* frame, uint16_t len)
+{
+	if(!(bank[0][R_ECON1] & ECON1_RXEN))
+	{
+		drops.disabled++;
+		return false;
+	}
+	if(!accepts(frame))
+	{
+		drops.filter++;
+		return false;
+	}
+	uint16_t padded = len < ETH_MIN_FRAME ? ETH_MIN_FRAME : len;
+	uint16_t count = padded + 4;
+	if(!(bank[2][R_MACON3] & MACON3_HFRMEN) && count > reg16(2, R_MAMXFL))
+	{
+		drops.too_long++;
+		return false;
+	}
+	uint16_t size = rxSize(len);
+	if(!room(len))
+	{
+		drops.full++;
+		return false;
+	}
+
+	uint16_t start = reg16(0, R_ERXST);
+	uint16_t ring = reg16(0, R_ERXND) - start + 1;
+	uint16_t next = start + (rx_write - start + size) % ring;
+	uint16_t status = RX_STATUS_OK;
+	if(frame[0] & 0x01)
+		status |= memcmp(frame, "\xff\xff\xff\xff\xff\xff", 6) == 0 ? RX_STATUS_BROADCAST : RX_STATUS_MULTICAST;
+	rxPut(next);
+	rxPut(next >> 8);
+	rxPut(count);
+	rxPut(count >> 8);
+	rxPut(status);
+	rxPut(status >> 8);
+
+	uint32_t crc = 0xffffffff;
+	for(uint16_t i = 0; i < padded; i++)
+	{
+		uint8_t value = i < len ? frame[i] : 0;
+		rxPut(value);
+		crc ^= value;
+		for(int b = 0; b < 8; b++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	crc = ~crc;
+	for(int i = 0; i < 4; i++)
+		rxPut(crc >> (8 * i));
+	rx_write = next;
+	bank[1][R_EPKTCNT]++;
+	return true;
+}
+
+bool Enc28j60Model::room(uint16_t len)
+{
+	return pending() < 255 && rxFree() > rxSize(len);
+}
+
+// header, frame padded to the minimum, crc, and the next packet starts on an even address
+uint16_t Enc28j60Model::rxSize(uint16_t len)
+{
+	uint16_t size = RX_HEADER_SIZE + (len < ETH_MIN_FRAME ? ETH_MIN_FRAME : len) + 4;
+	return size + (size & 1);
+}
+
+// the common registers are the same in every bank
+uint8_t* Enc28j60Model::reg(uint8_t address)
+{
+	if(address >= 0x1b)
+		return &bank[0][address];
+	return &bank[bank[0][R_ECON1] & ECON1_BSEL][address];
+}
+
+uint16_t Enc28j60Model::reg16(int bank_number, uint8_t address)
+{
+	return bank[bank_number][address] | ((bank[bank_number][address + 1] & 0x1f) << 8);
+}
+
+void Enc28j60Model::setReg16(int bank_number, uint8_t address, uint16_t value)
+{
+	bank[bank_number][address] = value;
+	bank[bank_number][address + 1] = value >> 8;
+}
+
+// a register write from the driver, with what the chip does on it
+void Enc28j60Model::writeReg(uint8_t address, uint8_t value)
+{
+	uint8_t* r = reg(address);
+	int bank_number = address >= 0x1b ? 0 : bank[0][R_ECON1] & ECON1_BSEL;
+
+	if(address == R_ECON2)
+	{
+		if((value & ECON2_PKTDEC) && bank[1][R_EPKTCNT] > 0)
+			bank[1][R_EPKTCNT]--;
+		value &= ~ECON2_PKTDEC;
+	}
+	else if(address == R_ECON1 && (value & ECON1_TXRTS))
+	{
+		// the frame goes out at once: control byte at ETXST, the frame up to ETXND
+		uint16_t start = reg16(0, R_ETXST);
+		uint16_t end = reg16(0, R_ETXND);
+		if(transmit && end > start && end < ENC_MEMORY_SIZE)
+			transmit(transmit_ctx, memory + start + 1, end - start);
+		value &= ~ECON1_TXRTS;
+		bank[0][R_EIR] |= EIR_TXIF;
+	}
+	else if(address == R_ESTAT)
+		value |= ESTAT_CLKRDY;
+	else if(bank_number == 1 && address == R_EPKTCNT)
+		return;
+	else if(bank_number == 3 && address == R_EREVID)
+		return;
+
+	*r = value;
+
+	if(bank_number == 0 && address == R_ERXST + 1)
+		rx_write = reg16(0, R_ERXST);
+	else if(bank_number == 2 && address == R_MICMD && (value & MICMD_MIIRD))
+		setReg16(2, R_MIRD, phy[bank[2][R_MIREGADR] & (ENC_PHY_COUNT - 1)]);
+	else if(bank_number == 2 && address == R_MIWR + 1)
+		phy[bank[2][R_MIREGADR] & (ENC_PHY_COUNT - 1)] = bank[2][R_MIWR] | (value << 8);
+}
+
+void Enc28j60Model::memoryWrite(uint16_t* pointer, uint8_t value)
+{
+	memory[*pointer] = value;
+	*pointer = (*pointer + 1) & (ENC_MEMORY_SIZE - 1);
+}
+
+// the receive filters the driver enables: unicast to our address, broadcast, multicast
+bool Enc28j60Model::accepts(const uint8_t* frame)
+{
+	uint8_t filter = bank[1][R_ERXFCON];
+	if(!(filter & (ERXFCON_UCEN | ERXFCON_MCEN | ERXFCON_BCEN)))
+		return true;
+	if(memcmp(frame, "\xff\xff\xff\xff\xff\xff", 6) == 0)
+		return filter & ERXFCON_BCEN;
+	if(frame[0] & 0x01)
+		return filter & ERXFCON_MCEN;
+	// MAADR1 (the first byte) is at 0x04, see the MAADR defines in enc28j60.cpp
+	uint8_t* b = bank[3];
+	uint8_t mac[6] = { b[4], b[5], b[2], b[3], b[0], b[1] };
+	return (filter & ERXFCON_UCEN) && memcmp(frame, mac, 6) == 0;
+}
+
+// room between the write pointer and ERXRDPT, datasheet section 7.2.4
+uint16_t Enc28j60Model::rxFree()
+{
+	uint16_t size = reg16(0, R_ERXND) - reg16(0, R_ERXST);
+	uint16_t read = reg16(0, R_ERXRDPT);
+	if(rx_write > read)
+		return size - (rx_write - read);
+	if(rx_write == read)
+		return size;
+	return read - rx_write - 1;
+}
+
+void Enc28j60Model::rxPut(uint8_t value)
+{
+	memory[rx_write] = value;
+	if(rx_write == reg16(0, R_ERXND))
+		rx_write = reg16(0, R_ERXST);
+	else
+		rx_write = (rx_write + 1) & (ENC_MEMORY_SIZE - 1);
+}
+
+// arduino
+
+uint8_t SPCR;
+uint8_t SPSR = 1 << SPIF;
+ShimSpiData SPDR;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	if(pin == SHIM_SELECT_PIN)
+		shim_enc.select(value == LOW);
+}
+
+unsigned long millis()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000UL + now.tv_nsec / 1000000;
+}
+
+// nothing waits on the host, the model is ready at once
+void delay(unsigned long ms)
+{
+}
@@ -0,0 +1,93 @@
+#ifndef _SHIM_H_
+#define _SHIM_H_
+
+// the ENC28J60 as the driver sees it over SPI
+//
+// enc28j60.cpp is compiled for the host unchanged: every byte it writes to SPDR goes to the
+// model, which decodes the SPI opcodes (register read and write, bit set and clear, buffer
+// memory read and write, soft reset) like the chip does. the model keeps the four register
+// banks, the phy registers and the 8K buffer memory. frames from the capture are written
+// into the receive ring with their header like the MAC does, frames the driver transmits
+// are handed to the bench.
+
+#include <stdint.h>
+
+// the chip select pin the bench passes to ether.begin, as ledboard.ino does
+#define SHIM_SELECT_PIN 8
+
+#define ENC_MEMORY_SIZE 8192
+#define ENC_PHY_COUNT 32
+
+// frames the MAC did not store
+struct EncDrops
+{
+	uint64_t filter;	// not for our mac, broadcast or multicast off
+	uint64_t too_long;	// longer than MAMXFL
+	uint64_t full;		// no room in the receive ring or EPKTCNT at 255
+	uint64_t disabled;	// receive not enabled
+};
+
+class Enc28j60Model
+{
+public:
+	Enc28j60Model() : transmit(0), transmit_ctx(0), spi_bytes(0), spi_transactions(0) { reset(); }
+
+	void reset();
+
+	// chip select, low starts an SPI transaction
+	void select(bool low);
+	// one SPI byte, returns the byte the chip shifts out at the same time
+	uint8_t transfer(uint8_t value);
+
+	// a frame from the wire without its crc, false when the MAC drops it
+	bool receive(const uint8_t* frame, uint16_t len);
+	// whether a frame of len bytes fits in the receive ring now
+	bool room(uint16_t len);
+	// frames in the receive ring, EPKTCNT
+	uint8_t pending() { return bank[1][0x19]; }
+
+	// called for every frame the driver transmits, without the control byte
+	void (*transmit)(void* ctx, const uint8_t* frame, uint16_t len);
+	void* transmit_ctx;
+
+	// counters
+	uint64_t spi_bytes;
+	uint64_t spi_transactions;
+	EncDrops drops;
+
+private:
+	uint8_t bank[4][32];	// 0x1b - 0x1f are the same registers in every bank, kept in bank 0
+	uint16_t phy[ENC_PHY_COUNT];
+	uint8_t memory[ENC_MEMORY_SIZE];
+	uint16_t rx_write;		// ERXWRPT
+
+	// transaction state: the opcode byte has been seen, and which opcode it was
+	bool selected;
+	bool have_opcode;
+	uint8_t opcode;
+	uint8_t address;
+
+	uint8_t* reg(uint8_t address);
+	uint16_t reg16(int bank_number, uint8_t address);
+	void setReg16(int bank_number, uint8_t address, uint16_t value);
+	void writeReg(uint8_t address, uint8_t value);
+	void memoryWrite(uint16_t* pointer, uint8_t value);
+	bool accepts(const uint8_t* frame);
+	uint16_t rxFree();
+	uint16_t rxSize(uint16_t len);
+	void rxPut(uint8_t value);
+};
+
+extern Enc28j60Model shim_enc;
+
+// SPI data register, writing starts a transfer to the model, reading gives what came back
+class ShimSpiData
+{
+public:
+	uint8_t value;
+
+	operator uint8_t() { return value; }
+	ShimSpiData& operator=(uint8_t v) { value = shim_enc.transfer(v); return *this; }
+};
+
+#endif //_SHIM_H_
@@ -0,0 +1,12 @@
+#ifndef _SHIM_AVR_INTERRUPT_H_
+#define _SHIM_AVR_INTERRUPT_H_
+
+// host replacement for <avr/interrupt.h>, the emulator calls the vectors itself
+#include "io.h"
+
+#define ISR(vector, ...) extern "C" void vector(void)
+// after sei() in an interrupt routine the emulator lets other interrupts in, at every port write
+#define sei() do { if(shim_hooks.sei) shim_hooks.sei(shim_hooks.ctx); } while(0)
+#define cli()
+
+#endif //_SHIM_AVR_INTERRUPT_H_
@@ -0,0 +1,49 @@
+#ifndef _SHIM_AVR_IO_H_
+#define _SHIM_AVR_IO_H_
+
+// host replacement for <avr/io.h>, see shim.h
+#include "../shim.h"
+
+extern "C" ShimPort PORTB, PORTC, PORTD;
+extern "C" ShimRegister DDRB, DDRC, DDRD;
+extern "C" ShimRegister UCSR0A, UCSR0B, UCSR0C;
+extern "C" ShimRegister16 UBRR0;
+extern "C" ShimUart UDR0;
+extern "C" ShimRegister WDTCSR;
+extern "C" ShimRegister TCCR1A, TCCR1B, TIMSK1;
+extern "C" ShimRegister16 OCR1A, OCR1B;
+extern "C" ShimTimer16 TCNT1;
+
+// timer 1, only ctc mode without prescaler is emulated
+#define WGM12 3
+#define CS10 0
+#define OCIE1A 1
+#define OCIE1B 2
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#endif //_SHIM_AVR_IO_H_
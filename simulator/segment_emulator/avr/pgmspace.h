@@ -0,0 +1,11 @@
+#ifndef _SHIM_AVR_PGMSPACE_H_
+#define _SHIM_AVR_PGMSPACE_H_
+
+// host replacement for <avr/pgmspace.h>, flash is ordinary memory
+#include "../shim.h"
+
+#define PROGMEM
+// lpm takes 3 cycles
+#define pgm_read_byte(address) (shim_hooks.cycles += 3, *(const unsigned char*)(address))
+
+#endif //_SHIM_AVR_PGMSPACE_H_
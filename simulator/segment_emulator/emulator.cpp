@@ -0,0 +1,851 @@
+// emulates a daisy chain of led segments running the real segment firmware
+//
+// every segment loads its own copy of segment.so (leds.c and uart.c built for the host),
+// the emulator feeds the serial stream into the first segment at the modelled baud rate,
+// calls the receive interrupt for every byte and do_leds in between, and passes the bytes
+// a segment transmits on to the next one. the panel is modelled from the CLK, STROBE, OE
+// and row select edges, the time every led is on gives the pwm averaged image.
+//
+//	./segment_emulator -i frames.bin -o image.pgm		replay a file written by ledboard -d
+//	./segment_emulator -p -o image.pgm					create a pty for ledboard -d to write to
+
+#include "shim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <termios.h>
+#include <sys/mman.h>
+
+// clock of the segments
+#define EMU_F_CPU 16000000ULL
+#define SEGMENT_MAX 32
+#define SEGMENT_WIDTH 32
+#define SEGMENT_HEIGHT 16
+#define SEGMENT_PIXELS (SEGMENT_WIDTH * SEGMENT_HEIGHT)
+// frames whose start time is remembered until the last segment has them
+#define FRAME_RING 64
+
+// cycle estimates for the code between the register accesses, from the avr-gcc -Os listing:
+// a do_leds call besides its register accesses (call, loop, return)
+#define LEDS_CALL_CYCLES 60
+// a pixel shifted into the panel besides its port writes (loads, shifts, tests, loop)
+#define PIXEL_EXTRA_CYCLES 10
+// an interrupt besides its register accesses (entry, register saves, reti)
+#define ISR_CYCLES 40
+
+// interrupts the emulator delivers
+#define EVENT_NONE 0
+#define EVENT_RX 1
+#define EVENT_COMPA 2
+#define EVENT_COMPB 3
+
+// port bits, as in leds.c
+#define BIT_A2 0
+#define BIT_A1 1
+#define BIT_A0 2
+#define BIT_CLK 3
+#define BIT_OE 4
+#define BIT_STROBE 5
+#define BIT_UDAT 1
+#define BIT_LDAT 2
+// timer 1 bits, as in avr/io.h
+#define BIT_CS10 0
+#define BIT_OCIE1A 1
+#define BIT_OCIE1B 2
+
+struct Arrival
+{
+	uint64_t time;
+	uint8_t value;
+};
+
+struct Segment
+{
+	int index;
+
+	// this segment's copy of the firmware
+	ShimHooks* hooks;
+	void (*do_leds)(void);
+	void (*rx_isr)(void);
+	void (*compa_isr)(void);
+	void (*compb_isr)(void);
+	uint8_t** dispmem;
+	ShimRegister* tccr1b;
+	ShimRegister* timsk1;
+	ShimRegister16* ocr1a;
+	ShimRegister16* ocr1b;
+
+	// timer 1 counted from 0 at timer_base, compare match B happens once per period
+	uint64_t timer_base;
+	bool compb_done;
+	// in the timer interrupt, after its sei() it lets others in, and when the last interrupt ended
+	bool in_compa;
+	bool nesting;
+	bool late;
+	uint64_t isr_end;
+
+	// bytes on the way to this segment
+	Arrival* queue;
+	uint32_t queue_size;
+	uint32_t queue_head;
+	uint32_t queue_tail;
+
+	// transmitter, the last byte written leaves at tx_end
+	uint64_t tx_end;
+
+	// panel: shift registers, latches, and what was shown since when
+	uint8_t portb;
+	uint8_t portc;
+	uint8_t shift_upper[SEGMENT_WIDTH];
+	uint8_t shift_lower[SEGMENT_WIDTH];
+	uint8_t latch_upper[SEGMENT_WIDTH];
+	uint8_t latch_lower[SEGMENT_WIDTH];
+	uint64_t shown_since;
+	int shown_row;
+	uint64_t window_start;
+	uint64_t on[SEGMENT_PIXELS];
+	uint64_t enabled[SEGMENT_HEIGHT / 2];
+
+	// data bytes since the last reset, a complete frame waiting for the latch byte,
+	// and frames this segment has shown
+	uint16_t captured;
+	bool latching;
+	bool ready;
+	// command waiting for its parameter bytes, they are not pixels
+	uint8_t cmd;
+	uint8_t nparam;
+	uint64_t frames;
+	uint64_t shown_at;
+
+	uint64_t bytes_received;
+	uint64_t refreshes;
+	// the last two times row 0 was shown after another row
+	uint64_t refresh_at;
+	uint64_t refresh_prev;
+	uint64_t isr_cycles;
+	uint64_t overruns;
+	// compare match A while the previous one was still running
+	uint64_t timer_late;
+};
+
+static Segment segments[SEGMENT_MAX];
+static int segment_count = 9;
+static uint64_t byte_cycles;
+
+// the ledboard panel layout, segment i of the chain sits at column, row
+static int layout[SEGMENT_MAX][2] = {
+	{2, 0}, {2, 1}, {2, 2},
+	{1, 2}, {1, 1}, {1, 0},
+	{0, 0}, {0, 1}, {0, 2},
+};
+static int columns = 3;
+static int rows = 3;
+
+// frame statistics, from the reset byte entering the chain to the last segment showing it,
+// and the time between the first and the last segment changing over
+static uint64_t frame_start[FRAME_RING];
+static uint64_t frames_started;
+static uint64_t frames_done;
+static uint64_t frame_bytes;
+static uint64_t frame_bytes_total;
+static uint64_t frame_time_total;
+static uint64_t frame_time_min;
+static uint64_t frame_time_max;
+static uint64_t tear_total;
+static uint64_t tear_max;
+// the pwm average is taken from here on, restarted for every complete frame
+static uint64_t window_start;
+// time all segments have run to
+static uint64_t now_cycles;
+
+static volatile bool running = true;
+
+static void queuePush(Segment* segment, uint64_t time, uint8_t value)
+{
+	if(segment->queue_tail - segment->queue_head == segment->queue_size)
+	{
+		// grow, keeping the order
+		uint32_t size = segment->queue_size ? segment->queue_size * 2 : 4096;
+		Arrival* queue = (Arrival*)malloc(size * sizeof(Arrival));
+		for(uint32_t i = segment->queue_head; i != segment->queue_tail; i++)
+			queue[i - segment->queue_head] = segment->queue[i % segment->queue_size];
+		segment->queue_tail -= segment->queue_head;
+		segment->queue_head = 0;
+		free(segment->queue);
+		segment->queue = queue;
+		segment->queue_size = size;
+	}
+	Arrival* arrival = &segment->queue[segment->queue_tail++ % segment->queue_size];
+	arrival->time = time;
+	arrival->value = value;
+}
+
+// add the time the current row was shown to its leds
+static void show(Segment* segment, uint64_t now)
+{
+	if(!(segment->portc & (1 << BIT_OE)))
+	{
+		int row = ((segment->portc >> BIT_A0) & 1) | (((segment->portc >> BIT_A1) & 1) << 1) | (((segment->portc >> BIT_A2) & 1) << 2);
+		uint64_t shown = now - segment->shown_since;
+		segment->enabled[row] += shown;
+		for(int x = 0; x < SEGMENT_WIDTH; x++)
+		{
+			// the first pixel clocked in ends up at the far end of the shift register
+			if(segment->latch_upper[x])
+				segment->on[row * SEGMENT_WIDTH + x] += shown;
+			if(segment->latch_lower[x])
+				segment->on[(row + 8) * SEGMENT_WIDTH + x] += shown;
+		}
+	}
+	segment->shown_since = now;
+}
+
+static void account(Segment* segment, uint64_t now)
+{
+	// a frame completed since: the average starts over at that time
+	if(segment->window_start != window_start && now >= window_start)
+	{
+		if(segment->shown_since < window_start)
+			show(segment, window_start);
+		memset(segment->on, 0, sizeof segment->on);
+		memset(segment->enabled, 0, sizeof segment->enabled);
+		segment->window_start = window_start;
+	}
+	show(segment, now);
+}
+
+static void nest(Segment* segment);
+
+static void portWrite(void* ctx, int port, uint8_t old, uint8_t value)
+{
+	Segment* segment = (Segment*)ctx;
+	uint64_t now = segment->hooks->cycles;
+	if(port == SHIM_PORTB)
+	{
+		segment->portb = value;
+		return;
+	}
+	if(port != SHIM_PORTC)
+		return;
+
+	uint8_t rising = ~old & value;
+	if(rising & (1 << BIT_CLK))
+	{
+		memmove(segment->shift_upper, segment->shift_upper + 1, SEGMENT_WIDTH - 1);
+		memmove(segment->shift_lower, segment->shift_lower + 1, SEGMENT_WIDTH - 1);
+		segment->shift_upper[SEGMENT_WIDTH - 1] = (segment->portb >> BIT_UDAT) & 1;
+		segment->shift_lower[SEGMENT_WIDTH - 1] = (segment->portb >> BIT_LDAT) & 1;
+		segment->hooks->cycles += PIXEL_EXTRA_CYCLES;
+	}
+
+	uint8_t shown_bits = (1 << BIT_OE) | (1 << BIT_A0) | (1 << BIT_A1) | (1 << BIT_A2);
+	if((rising & (1 << BIT_STROBE)) || ((old ^ value) & shown_bits))
+	{
+		account(segment, now);
+		if(rising & (1 << BIT_STROBE))
+		{
+			memcpy(segment->latch_upper, segment->shift_upper, SEGMENT_WIDTH);
+			memcpy(segment->latch_lower, segment->shift_lower, SEGMENT_WIDTH);
+		}
+		// row 0 shown after another row: one refresh of the whole segment
+		if(old & ~value & (1 << BIT_OE))
+		{
+			int row = ((value >> BIT_A0) & 1) | (((value >> BIT_A1) & 1) << 1) | (((value >> BIT_A2) & 1) << 2);
+			if(!row && segment->shown_row)
+			{
+				segment->refreshes++;
+				segment->refresh_prev = segment->refresh_at;
+				segment->refresh_at = now;
+			}
+			segment->shown_row = row;
+		}
+	}
+	segment->portc = value;
+
+	// an interrupt that lets others in is interrupted at its port writes
+	if(segment->nesting)
+		nest(segment);
+}
+
+// the usart holds one byte in the shift register and one in UDR0, more are lost
+static void uartWrite(void* ctx, uint8_t value)
+{
+	Segment* segment = (Segment*)ctx;
+	uint64_t now = segment->hooks->cycles;
+	if(segment->tx_end > now + byte_cycles)
+	{
+		segment->overruns++;
+		return;
+	}
+	segment->tx_end = (segment->tx_end > now ? segment->tx_end : now) + byte_cycles;
+	if(segment->index + 1 < segment_count)
+		queuePush(&segments[segment->index + 1], segment->tx_end, value);
+}
+
+// mirror of the capture in uart.c, to find when a segment has a whole frame
+static void frameProgress(Segment* segment, uint8_t value, uint64_t now)
+{
+	if(segment->index == 0)
+	{
+		if(value == 0x80)
+		{
+			if(frames_started)
+				frame_bytes_total += frame_bytes;
+			frame_bytes = 0;
+			frame_start[frames_started++ % FRAME_RING] = now;
+		}
+		frame_bytes++;
+	}
+
+	if(value & 0x80)
+		segment->cmd = 0;
+	if(value == 0x80)
+	{
+		segment->captured = 0;
+		segment->ready = false;
+		return;
+	}
+	if(value == 0xa0 || value == 0xa1)
+	{
+		segment->cmd = value;
+		segment->nparam = 0;
+		return;
+	}
+	if(segment->cmd)
+	{
+		// brightness takes the level, fade the level and the steps
+		if(++segment->nparam == (segment->cmd == 0xa0 ? 1 : 2))
+			segment->cmd = 0;
+		return;
+	}
+	if(value == 0x90)
+	{
+		segment->latching = true;
+		if(!segment->ready)
+			return;
+		segment->ready = false;
+	}
+	else
+	{
+		if(value & 0x80 || segment->captured == SEGMENT_PIXELS)
+			return;
+		if(++segment->captured < SEGMENT_PIXELS)
+			return;
+		if(segment->latching)
+		{
+			segment->ready = true;
+			return;
+		}
+	}
+
+	segment->frames++;
+	segment->shown_at = now;
+	if(segment->index != segment_count - 1 || !frames_started)
+		return;
+	uint64_t time = now - frame_start[(segment->frames - 1) % FRAME_RING];
+	frame_time_total += time;
+	if(!frames_done || time < frame_time_min) frame_time_min = time;
+	if(time > frame_time_max) frame_time_max = time;
+	uint64_t first = now;
+	for(int i = 0; i < segment_count; i++)
+	{
+		if(segments[i].frames == segment->frames && segments[i].shown_at < first)
+			first = segments[i].shown_at;
+	}
+	tear_total += now - first;
+	if(now - first > tear_max) tear_max = now - first;
+	frames_done++;
+
+	// the image from here on shows this frame
+	window_start = now;
+}
+
+// timer 1 counts from timer_base, a write moves timer_base
+static uint16_t timerRead(void* ctx)
+{
+	Segment* segment = (Segment*)ctx;
+	return segment->hooks->cycles - segment->timer_base;
+}
+
+static void timerWrite(void* ctx, uint16_t value)
+{
+	Segment* segment = (Segment*)ctx;
+	segment->timer_base = segment->hooks->cycles - value;
+	segment->compb_done = segment->ocr1b && segment->ocr1b->value < value;
+}
+
+// sei() in the main loop changes nothing, interrupts are always delivered there
+static void interruptsEnabled(void* ctx)
+{
+	Segment* segment = (Segment*)ctx;
+	if(segment->in_compa)
+		segment->nesting = true;
+}
+
+static void runLeds(Segment* segment)
+{
+	segment->hooks->cycles += LEDS_CALL_CYCLES;
+	segment->do_leds();
+}
+
+// the first interrupt that is due at or before limit, in the order of the avr vector table
+static int nextEvent(Segment* segment, uint64_t limit, uint64_t* time)
+{
+	int event = EVENT_NONE;
+	*time = limit;
+	if(segment->queue_head != segment->queue_tail && segment->queue[segment->queue_head % segment->queue_size].time <= *time)
+	{
+		event = EVENT_RX;
+		*time = segment->queue[segment->queue_head % segment->queue_size].time;
+	}
+	// ctc mode without prescaler: the counter runs from 0 to OCR1A
+	if(segment->compa_isr && (segment->tccr1b->value & (1 << BIT_CS10)))
+	{
+		uint64_t compb = segment->timer_base + segment->ocr1b->value;
+		if((segment->timsk1->value & (1 << BIT_OCIE1B)) && !segment->compb_done &&
+			segment->ocr1b->value <= segment->ocr1a->value && compb <= *time)
+		{
+			event = EVENT_COMPB;
+			*time = compb;
+		}
+		uint64_t compa = segment->timer_base + segment->ocr1a->value;
+		if((segment->timsk1->value & (1 << BIT_OCIE1A)) && compa <= *time)
+		{
+			event = EVENT_COMPA;
+			*time = compa;
+		}
+	}
+	return event;
+}
+
+// run the interrupt routine of an event, from the current cycle count on
+static void runEvent(Segment* segment, int event, uint64_t time)
+{
+	ShimHooks* hooks = segment->hooks;
+	hooks->cycles += ISR_CYCLES;
+	switch(event)
+	{
+		case EVENT_RX:
+		{
+			Arrival arrival = segment->queue[segment->queue_head++ % segment->queue_size];
+			hooks->rx = arrival.value;
+			segment->rx_isr();
+			segment->bytes_received++;
+			frameProgress(segment, arrival.value, arrival.time);
+			break;
+		}
+		case EVENT_COMPA:
+			// the counter starts over, the routine sets the compare values of this period
+			segment->timer_base = time + 1;
+			segment->compb_done = false;
+			segment->in_compa = true;
+			segment->late = false;
+			segment->compa_isr();
+			segment->in_compa = false;
+			segment->nesting = false;
+			if(segment->late)
+				segment->timer_late++;
+			break;
+		case EVENT_COMPB:
+			segment->compb_done = true;
+			segment->compb_isr();
+			break;
+	}
+}
+
+// deliver the interrupts that became due while an interrupt that lets others in runs,
+// a compare match A means the previous period was too short for its routine
+static void nest(Segment* segment)
+{
+	uint64_t time;
+	int event;
+	segment->nesting = false;
+	while((event = nextEvent(segment, segment->hooks->cycles, &time)) != EVENT_NONE)
+	{
+		if(event == EVENT_COMPA)
+		{
+			segment->late = true;
+			break;
+		}
+		runEvent(segment, event, time);
+	}
+	segment->nesting = true;
+}
+
+// run a segment up to time, handling every interrupt that happened before
+static void runSegment(Segment* segment, uint64_t until)
+{
+	ShimHooks* hooks = segment->hooks;
+	uint64_t time;
+	int event;
+	while((event = nextEvent(segment, until, &time)) != EVENT_NONE)
+	{
+		// the main loop runs until the interrupt
+		while(hooks->cycles < time)
+			runLeds(segment);
+
+		// the interrupt runs at its time, or after the one before it, and stretches the
+		// do_leds call it interrupted
+		uint64_t start = time > segment->isr_end ? time : segment->isr_end;
+		uint64_t resume = hooks->cycles;
+		hooks->cycles = start;
+		runEvent(segment, event, time);
+		uint64_t cost = hooks->cycles - start;
+		segment->isr_end = hooks->cycles;
+		hooks->cycles = resume + cost;
+		segment->isr_cycles += cost;
+	}
+	while(hooks->cycles < until)
+		runLeds(segment);
+}
+
+// the segments run in steps of a byte time, so none is far ahead of the others when a frame completes
+static void runAll(uint64_t until)
+{
+	while(now_cycles < until)
+	{
+		now_cycles = (until - now_cycles > byte_cycles ? now_cycles + byte_cycles : until);
+		for(int i = 0; i < segment_count; i++)
+			runSegment(&segments[i], now_cycles);
+	}
+}
+
+// a private copy of the firmware, a memfd gives every segment a file of its own
+static bool loadSegment(Segment* segment, const char* path)
+{
+	int in = open(path, O_RDONLY);
+	if(in < 0)
+	{
+		printf("Can not open %s\n", path);
+		return false;
+	}
+	int fd = memfd_create("segment", MFD_CLOEXEC);
+	char buffer[65536];
+	ssize_t len;
+	while((len = read(in, buffer, sizeof buffer)) > 0)
+	{
+		if(write(fd, buffer, len) != len)
+			return false;
+	}
+	close(in);
+
+	char fd_path[64];
+	snprintf(fd_path, sizeof fd_path, "/proc/self/fd/%d", fd);
+	// the fd stays open, dlopen would hand out the loaded copy again for a path it has seen
+	void* handle = dlopen(fd_path, RTLD_NOW | RTLD_LOCAL);
+	if(!handle)
+	{
+		printf("Can not load %s: %s\n", path, dlerror());
+		return false;
+	}
+
+	segment->hooks = (ShimHooks*)dlsym(handle, "shim_hooks");
+	segment->do_leds = (void (*)(void))dlsym(handle, "do_leds");
+	segment->rx_isr = (void (*)(void))dlsym(handle, "USART_RX_vect");
+	segment->dispmem = (uint8_t**)dlsym(handle, "dispmem");
+	// a firmware that refreshes from the main loop has no timer interrupts
+	segment->compa_isr = (void (*)(void))dlsym(handle, "TIMER1_COMPA_vect");
+	segment->compb_isr = (void (*)(void))dlsym(handle, "TIMER1_COMPB_vect");
+	segment->tccr1b = (ShimRegister*)dlsym(handle, "TCCR1B");
+	segment->timsk1 = (ShimRegister*)dlsym(handle, "TIMSK1");
+	segment->ocr1a = (ShimRegister16*)dlsym(handle, "OCR1A");
+	segment->ocr1b = (ShimRegister16*)dlsym(handle, "OCR1B");
+	void (*boot)(void) = (void (*)(void))dlsym(handle, "segment_boot");
+	if(!segment->hooks || !segment->do_leds || !segment->rx_isr || !segment->dispmem || !boot ||
+		(segment->compa_isr && (!segment->compb_isr || !segment->tccr1b || !segment->timsk1 || !segment->ocr1a || !segment->ocr1b)))
+	{
+		printf("%s is not a segment firmware build\n", path);
+		return false;
+	}
+	segment->hooks->port_write = &portWrite;
+	segment->hooks->uart_write = &uartWrite;
+	segment->hooks->timer_read = &timerRead;
+	segment->hooks->timer_write = &timerWrite;
+	segment->hooks->sei = &interruptsEnabled;
+	segment->hooks->ctx = segment;
+	boot();
+	return true;
+}
+
+// pwm averaged image of the whole chain, a led that is on whenever its row is shown is white
+static bool writeImage(const char* path)
+{
+	int width = columns * SEGMENT_WIDTH;
+	int height = rows * SEGMENT_HEIGHT;
+	static uint8_t image[SEGMENT_MAX * SEGMENT_PIXELS];
+	memset(image, 0, width * height);
+	for(int i = 0; i < segment_count; i++)
+	{
+		Segment* segment = &segments[i];
+		account(segment, segment->hooks->cycles);
+		for(int y = 0; y < SEGMENT_HEIGHT; y++)
+		{
+			uint64_t enabled = segment->enabled[y % 8];
+			for(int x = 0; x < SEGMENT_WIDTH; x++)
+			{
+				uint64_t on = segment->on[y * SEGMENT_WIDTH + x];
+				int pos = (layout[i][1] * SEGMENT_HEIGHT + y) * width + layout[i][0] * SEGMENT_WIDTH + x;
+				image[pos] = enabled ? on * 255 / enabled : 0;
+			}
+		}
+	}
+
+	FILE* file = fopen(path, "wb");
+	if(!file)
+	{
+		printf("Can not write %s\n", path);
+		return false;
+	}
+	fprintf(file, "P5\n%d %d\n255\n", width, height);
+	fwrite(image, 1, width * height, file);
+	fclose(file);
+	return true;
+}
+
+static double ms(uint64_t cycles)
+{
+	return cycles * 1000.0 / EMU_F_CPU;
+}
+
+static void report(uint64_t now, uint64_t backlog)
+{
+	uint64_t started = frames_started > 1 ? frames_started - 1 : 0;
+	double bytes = started ? (double)frame_bytes_total / started : frame_bytes;
+	printf("modelled %.1f ms: %llu frames started, %llu complete", ms(now),
+		(unsigned long long)frames_started, (unsigned long long)frames_done);
+	if(frames_done)
+	{
+		printf(", frame time %.2f ms (min %.2f, max %.2f)", ms(frame_time_total / frames_done),
+			ms(frame_time_min), ms(frame_time_max));
+	}
+	printf("\n");
+	if(frames_done)
+	{
+		printf("  segments change over within %.2f ms (max %.2f)\n", ms(tear_total / frames_done), ms(tear_max));
+	}
+	if(bytes)
+	{
+		printf("  %.0f bytes per frame, the link allows %.1f fps\n", bytes, EMU_F_CPU / (bytes * byte_cycles));
+	}
+	if(backlog)
+	{
+		printf("  input is %.1f ms ahead of the modelled link\n", ms(backlog));
+	}
+	for(int i = 0; i < segment_count; i++)
+	{
+		Segment* segment = &segments[i];
+		printf("  segment %d: %llu bytes, refresh %.0f Hz, interrupts %.1f%% of the cpu, %llu bytes lost, %llu late periods\n", i,
+			(unsigned long long)segment->bytes_received,
+			now ? segment->refreshes * (double)EMU_F_CPU / now : 0,
+			now ? segment->isr_cycles * 100.0 / now : 0,
+			(unsigned long long)segment->overruns,
+			(unsigned long long)segment->timer_late);
+		// how long the leds were enabled since the last frame, the brightness of the segment
+		account(segment, segment->hooks->cycles);
+		uint64_t enabled = 0;
+		for(int row = 0; row < SEGMENT_HEIGHT / 2; row++)
+			enabled += segment->enabled[row];
+		uint64_t window = segment->hooks->cycles - segment->window_start;
+		if(window)
+			printf("    output enabled %.1f%% of the time since the last frame\n", enabled * 100.0 / window);
+	}
+
+	// when every segment starts its refresh, relative to the first segment
+	Segment* first = &segments[0];
+	if(segment_count > 1 && first->refresh_prev)
+	{
+		int64_t period = first->refresh_at - first->refresh_prev;
+		double spread = 0;
+		printf("  refresh phase to segment 0 in us:");
+		for(int i = 1; i < segment_count; i++)
+		{
+			int64_t offset = ((int64_t)(segments[i].refresh_at - first->refresh_at) % period + period) % period;
+			if(offset > period / 2)
+				offset -= period;
+			double us = offset * 1e6 / EMU_F_CPU;
+			printf(" %.1f", us);
+			if(fabs(us) > spread)
+				spread = fabs(us);
+		}
+		printf(", all within %.1f us of a %.2f ms refresh\n", spread, ms(period));
+	}
+	fflush(stdout);
+}
+
+static uint64_t realCycles(struct timespec* start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t ns = (now.tv_sec - start->tv_sec) * 1000000000ULL + now.tv_nsec - start->tv_nsec;
+	return ns * (EMU_F_CPU / 1000000) / 1000;
+}
+
+static void stop(int sig)
+{
+	running = false;
+}
+
+static void usage(const char* name)
+{
+	printf("Usage: %s (-i file | -p) [-o image.pgm] [-b baud] [-n segments] [-s segment.so] [-t ms]\n", name);
+	printf("  -i file       serial stream to replay, as written by ledboard -d file\n");
+	printf("  -p            create a pty and emulate what is written to it in real time\n");
+	printf("  -o image      write the pwm averaged image as pgm, every second with -p\n");
+	printf("  -b baud       modelled baud rate (default 500000)\n");
+	printf("  -n segments   segments in the chain, 9 uses the ledboard layout, other counts\n");
+	printf("                are placed in a row (default 9, max %d)\n", SEGMENT_MAX);
+	printf("  -s path       firmware build to load (default segment.so next to the emulator)\n");
+	printf("  -t ms         keep running after the end of the file (default 100)\n");
+	printf("  -j ms         power up the segments at random times up to ms apart (default 0)\n");
+}
+
+int main(int argc, char* argv[])
+{
+	const char* input = 0;
+	bool use_pty = false;
+	const char* output = 0;
+	uint32_t baud = 500000;
+	const char* firmware = 0;
+	int settle_ms = 100;
+	int jitter_ms = 0;
+
+	int opt;
+	while((opt = getopt(argc, argv, "i:po:b:n:s:t:j:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 'i': input = optarg; break;
+			case 'p': use_pty = true; break;
+			case 'o': output = optarg; break;
+			case 'b': baud = atoi(optarg); break;
+			case 'n': segment_count = atoi(optarg); break;
+			case 's': firmware = optarg; break;
+			case 't': settle_ms = atoi(optarg); break;
+			case 'j': jitter_ms = atoi(optarg); break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	if((!input && !use_pty) || segment_count < 1 || segment_count > SEGMENT_MAX || baud < 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(segment_count != 9)
+	{
+		for(int i = 0; i < segment_count; i++)
+		{
+			layout[i][0] = i;
+			layout[i][1] = 0;
+		}
+		columns = segment_count;
+		rows = 1;
+	}
+
+	// 8N1: a start bit, 8 data bits and a stop bit
+	byte_cycles = 10 * EMU_F_CPU / baud;
+
+	char default_firmware[4096];
+	if(!firmware)
+	{
+		ssize_t len = readlink("/proc/self/exe", default_firmware, sizeof default_firmware - 16);
+		if(len < 0) len = 0;
+		default_firmware[len] = 0;
+		char* slash = strrchr(default_firmware, '/');
+		strcpy(slash ? slash + 1 : default_firmware, "segment.so");
+		firmware = default_firmware;
+	}
+	for(int i = 0; i < segment_count; i++)
+	{
+		segments[i].index = i;
+		if(!loadSegment(&segments[i], firmware))
+			return 1;
+		// the timer starts counting when the segment powers up
+		if(jitter_ms > 0)
+			segments[i].timer_base = rand() % (jitter_ms * (EMU_F_CPU / 1000));
+	}
+
+	signal(SIGINT, &stop);
+	signal(SIGTERM, &stop);
+
+	uint64_t last = 0;
+	if(input)
+	{
+		// the file is sent back to back at the baud rate
+		FILE* file = fopen(input, "rb");
+		if(!file)
+		{
+			printf("Can not open %s\n", input);
+			return 1;
+		}
+		int c;
+		while((c = fgetc(file)) != EOF && running)
+		{
+			last += byte_cycles;
+			queuePush(&segments[0], last, c);
+			// keep the queue short for long recordings
+			if(segments[0].queue_tail - segments[0].queue_head > 65536)
+				runAll(last - 32768 * byte_cycles);
+		}
+		fclose(file);
+		uint64_t end = last + settle_ms * (EMU_F_CPU / 1000);
+		runAll(end);
+		report(end, 0);
+		if(output && !writeImage(output))
+			return 1;
+		return 0;
+	}
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+	{
+		printf("Can not create a pty\n");
+		return 1;
+	}
+	struct termios options;
+	tcgetattr(master, &options);
+	cfmakeraw(&options);
+	tcsetattr(master, TCSANOW, &options);
+	printf("emulating %d segments at %u baud, write to %s\n", segment_count, baud, ptsname(master));
+	fflush(stdout);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint64_t next_report = EMU_F_CPU;
+	while(running)
+	{
+		struct pollfd pfd = { master, POLLIN, 0 };
+		poll(&pfd, 1, 10);
+		uint64_t now = realCycles(&start);
+		uint8_t buffer[4096];
+		ssize_t len = (pfd.revents & POLLIN) ? read(master, buffer, sizeof buffer) : 0;
+		for(ssize_t i = 0; i < len; i++)
+		{
+			// bytes leave one after the other, but not before they were written
+			last = (last + byte_cycles > now ? last + byte_cycles : now);
+			queuePush(&segments[0], last, buffer[i]);
+		}
+		runAll(now);
+		if(now >= next_report)
+		{
+			next_report += EMU_F_CPU;
+			report(now, last > now ? last - now : 0);
+			if(output)
+				writeImage(output);
+		}
+	}
+	uint64_t now = realCycles(&start);
+	report(now, last > now ? last - now : 0);
+	if(output && !writeImage(output))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,39 @@
+// the segment firmware built as a shared object for the emulator
+// every segment of the chain loads its own copy, so the globals and the static
+// variables of the interrupt routines are separate for each segment
+
+#include "shim.h"
+
+extern "C" {
+
+ShimHooks shim_hooks;
+
+ShimPort PORTB = { 0, SHIM_PORTB };
+ShimPort PORTC = { 0, SHIM_PORTC };
+ShimPort PORTD = { 0, SHIM_PORTD };
+ShimRegister DDRB, DDRC, DDRD;
+ShimRegister UCSR0A, UCSR0B, UCSR0C;
+ShimRegister16 UBRR0;
+ShimUart UDR0;
+ShimRegister WDTCSR;
+ShimRegister TCCR1A, TCCR1B, TIMSK1;
+ShimRegister16 OCR1A, OCR1B;
+ShimTimer16 TCNT1;
+
+#include "leds.c"
+#include "uart.c"
+
+}
+
+#include "pic.h"
+
+// what main() does before it enters its do_leds loop
+extern "C" void segment_boot(void)
+{
+	initleds();
+	uart_setup();
+	for(int x = 0; x < 512; x++)
+	{
+		dispmem[x] = pgm_read_byte(picture + x);
+	}
+}
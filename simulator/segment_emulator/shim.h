@@ -0,0 +1,116 @@
+#ifndef _SHIM_H_
+#define _SHIM_H_
+
+// registers of the atmega328p as far as the segment firmware uses them
+//
+// the firmware is compiled for the host with these headers in front of the real avr ones.
+// every register access costs the cycles of an in/out, sbi or cbi instruction, port writes
+// are reported to the emulator so it can follow CLK, STROBE and OE like the panel does
+
+#include <stdint.h>
+
+// cycles of one i/o register access (sbi, cbi, in, out, lds, sts are 1 to 2 cycles)
+#define SHIM_IO_CYCLES 2
+
+#define SHIM_PORTB 0
+#define SHIM_PORTC 1
+#define SHIM_PORTD 2
+#define SHIM_PORT_COUNT 3
+
+// filled in by the emulator, every loaded copy of the firmware has its own
+struct ShimHooks
+{
+	// a port changed from old to value
+	void (*port_write)(void* ctx, int port, uint8_t old, uint8_t value);
+	// the firmware wrote UDR0, a byte for the next segment
+	void (*uart_write)(void* ctx, uint8_t value);
+	// timer 1 counter, the emulator counts it
+	uint16_t (*timer_read)(void* ctx);
+	void (*timer_write)(void* ctx, uint16_t value);
+	// the firmware enabled interrupts
+	void (*sei)(void* ctx);
+	void* ctx;
+	// cycles executed so far, advanced by every register access and by the emulator
+	uint64_t cycles;
+	// byte returned by reading UDR0
+	uint8_t rx;
+};
+
+extern "C" ShimHooks shim_hooks;
+
+// plain register, only costs time
+class ShimRegister
+{
+public:
+	uint8_t value;
+
+	operator uint8_t() { shim_hooks.cycles += SHIM_IO_CYCLES; return value; }
+	ShimRegister& operator=(uint8_t v) { shim_hooks.cycles += SHIM_IO_CYCLES; value = v; return *this; }
+	ShimRegister& operator|=(uint8_t v) { return *this = value | v; }
+	ShimRegister& operator&=(uint8_t v) { return *this = value & v; }
+};
+
+// 16 bit register, written as a whole
+class ShimRegister16
+{
+public:
+	uint16_t value;
+
+	operator uint16_t() { shim_hooks.cycles += 2 * SHIM_IO_CYCLES; return value; }
+	ShimRegister16& operator=(uint16_t v) { shim_hooks.cycles += 2 * SHIM_IO_CYCLES; value = v; return *this; }
+};
+
+// timer counter, reads and writes go to the emulator
+class ShimTimer16
+{
+public:
+	operator uint16_t()
+	{
+		shim_hooks.cycles += 2 * SHIM_IO_CYCLES;
+		return shim_hooks.timer_read ? shim_hooks.timer_read(shim_hooks.ctx) : 0;
+	}
+	ShimTimer16& operator=(uint16_t v)
+	{
+		shim_hooks.cycles += 2 * SHIM_IO_CYCLES;
+		if(shim_hooks.timer_write)
+			shim_hooks.timer_write(shim_hooks.ctx, v);
+		return *this;
+	}
+};
+
+// output port, changes go to the emulator
+class ShimPort
+{
+public:
+	uint8_t value;
+	int id;
+
+	operator uint8_t() { shim_hooks.cycles += SHIM_IO_CYCLES; return value; }
+	ShimPort& operator=(uint8_t v)
+	{
+		shim_hooks.cycles += SHIM_IO_CYCLES;
+		uint8_t old = value;
+		value = v;
+		if(old != v && shim_hooks.port_write)
+			shim_hooks.port_write(shim_hooks.ctx, id, old, v);
+		return *this;
+	}
+	ShimPort& operator|=(uint8_t v) { return *this = value | v; }
+	ShimPort& operator&=(uint8_t v) { return *this = value & v; }
+};
+
+// usart data register, reads the received byte and writes to the transmitter
+class ShimUart
+{
+public:
+	operator uint8_t() { shim_hooks.cycles += SHIM_IO_CYCLES; return shim_hooks.rx; }
+	ShimUart& operator=(uint8_t v)
+	{
+		shim_hooks.cycles += SHIM_IO_CYCLES;
+		if(shim_hooks.uart_write)
+			shim_hooks.uart_write(shim_hooks.ctx, v);
+		return *this;
+	}
+};
+
+#endif //_SHIM_H_
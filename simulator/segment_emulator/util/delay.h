@@ -0,0 +1,10 @@
+#ifndef _SHIM_UTIL_DELAY_H_
+#define _SHIM_UTIL_DELAY_H_
+
+// host replacement for <util/delay.h>, delays only advance the cycle counter
+#include "../shim.h"
+
+#define _delay_us(us) (shim_hooks.cycles += (uint64_t)((us) * (F_CPU / 1000000)))
+#define _delay_ms(ms) (shim_hooks.cycles += (uint64_t)((ms) * (F_CPU / 1000)))
+
+#endif //_SHIM_UTIL_DELAY_H_
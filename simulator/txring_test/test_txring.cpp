@@ -0,0 +1,150 @@
+// checks TxRing and TxExpander from the controller on the host
+//
+//	make test
+
+#include "TxRing.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+static void check(bool ok, const char* what)
+{
+	if(!ok)
+	{
+		printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// expand a byte and compare the output
+static void expectBytes(TxExpander* expander, uint8_t value, const uint8_t* expected, uint8_t count, const char* what)
+{
+	uint8_t out[7];
+	uint8_t n = expander->expand(value, out);
+	check(n == count && !memcmp(out, expected, count), what);
+}
+
+static void testRing()
+{
+	TxRing ring;
+	int puts = 0;
+	while(ring.put(puts))
+		puts++;
+	check(puts == TX_RING_SIZE - 1, "the ring holds 255 bytes");
+	check(ring.used() == TX_RING_SIZE - 1, "used() of a full ring");
+
+	uint8_t value;
+	bool ordered = true;
+	for(int i = 0; i < puts; i++)
+		ordered &= ring.get(&value) && value == (uint8_t)i;
+	check(ordered, "bytes come out in the order they went in");
+	check(ring.empty() && !ring.get(&value), "an emptied ring is empty");
+
+	// head and tail pass the end of the array many times, a third full
+	uint8_t next_put = 0, next_get = 0;
+	ordered = true;
+	for(int round = 0; round < 1000; round++)
+	{
+		for(int i = 0; i < 85; i++)
+			ordered &= ring.put(next_put++);
+		for(int i = 0; i < 85; i++)
+			ordered &= ring.get(&value) && value == next_get++;
+	}
+	check(ordered && ring.empty(), "order is kept across the wrap around");
+
+	// full with the head behind the tail
+	for(int i = 0; i < 100; i++)
+		ring.put(i);
+	for(int i = 0; i < 100; i++)
+		ring.get(&value);
+	puts = 0;
+	while(ring.put(puts))
+		puts++;
+	check(puts == TX_RING_SIZE - 1, "a wrapped ring holds 255 bytes");
+}
+
+static void testPixelsPerByte()
+{
+	TxExpander expander;
+	uint8_t out[7];
+	bool dropped = true;
+	for(int value = 0x81; value <= 0x8f; value++)
+		dropped &= expander.expand(value, out) == 0;
+	check(dropped, "0x81 - 0x8f are not sent on");
+
+	expander.expand(0x87, out);
+	check(expander.pixelsPerByte() == 7, "0x87 selects 7 pixels per byte");
+	const uint8_t reset[] = { 0x80 };
+	expectBytes(&expander, 0x80, reset, 1, "0x80 is sent on");
+	check(expander.pixelsPerByte() == 1, "0x80 goes back to 1 pixel per byte");
+	const uint8_t pixel[] = { 0x55 };
+	expectBytes(&expander, 0x55, pixel, 1, "1 pixel per byte is sent on unchanged");
+}
+
+static void testExpansion()
+{
+	TxExpander expander;
+	uint8_t out[7];
+	expander.expand(0x80, out);
+	expander.expand(0x87, out);
+	const uint8_t bits[] = { 0x7f, 0x00, 0x7f, 0x00, 0x7f, 0x00, 0x7f };
+	expectBytes(&expander, 0x55, bits, 7, "0x55 expands to 7 pixels, bit 0 first");
+
+	// 4608 pixels are 658 whole bytes and 2 pixels of the next
+	int pixels = 7;
+	for(int i = 1; i < TX_FRAME_PIXELS / 7; i++)
+		pixels += expander.expand(0x7f, out);
+	check(pixels == TX_FRAME_PIXELS / 7 * 7, "7 pixels for every byte of the frame");
+	check(expander.expand(0x7f, out) == TX_FRAME_PIXELS % 7, "the last byte stops at the end of the frame");
+	check(expander.expand(0x7f, out) == 0, "nothing after the end of the frame");
+
+	// the next frame starts counting again
+	expander.expand(0x80, out);
+	expander.expand(0x87, out);
+	check(expander.expand(0x7f, out) == 7, "a new frame expands again");
+}
+
+static void testCommands()
+{
+	TxExpander expander;
+	uint8_t out[7];
+	expander.expand(0x80, out);
+	expander.expand(0x87, out);
+
+	// parameter bytes are sent on as they are, in 7 pixels per byte too
+	const uint8_t brightness[] = { 0xa0 };
+	const uint8_t level[] = { 0x55 };
+	expectBytes(&expander, 0xa0, brightness, 1, "0xa0 is sent on");
+	expectBytes(&expander, 0x55, level, 1, "the 0xa0 level is not expanded");
+
+	const uint8_t fade[] = { 0xa1 };
+	const uint8_t steps[] = { 0x03 };
+	expectBytes(&expander, 0xa1, fade, 1, "0xa1 is sent on");
+	expectBytes(&expander, 0x55, level, 1, "the 0xa1 level is not expanded");
+	expectBytes(&expander, 0x03, steps, 1, "the 0xa1 steps are not expanded");
+
+	// the phase sync carries its hops in the command byte, the byte after it is pixels
+	const uint8_t sync[] = { 0xb0 };
+	expectBytes(&expander, 0xb0, sync, 1, "0xb0 is sent on");
+	check(expander.expand(0x55, out) == 7, "the byte after 0xb0 is expanded");
+	const uint8_t latch[] = { 0x90 };
+	expectBytes(&expander, 0x90, latch, 1, "0x90 is sent on");
+	check(expander.expand(0x55, out) == 7, "the byte after 0x90 is expanded");
+	check(expander.pixelsPerByte() == 7, "commands keep 7 pixels per byte");
+}
+
+int main()
+{
+	testRing();
+	testPixelsPerByte();
+	testExpansion();
+	testCommands();
+	if(failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}